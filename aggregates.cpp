@@ -0,0 +1,63 @@
+#include "aggregates.hpp"
+#include "log_parser.hpp"
+
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <filesystem>
+
+namespace fs = std::filesystem;
+
+namespace tslib
+{
+    // Формат: строка на окно "имя start count sum min max mean m2"
+    bool SaveAggregates(const std::string &file_path, const AggregateSet &aggregates)
+    {
+        std::string temp_path = file_path + ".tmp";
+        {
+            std::ofstream file(temp_path, std::ios::trunc);
+            if (!file) return false;
+
+            file << std::setprecision(17);
+            for (const auto &[name, agg] : aggregates)
+            {
+                file << name << ' ' << agg.start << ' ' << agg.count << ' ' << agg.sum << ' '
+                     << agg.min << ' ' << agg.max << ' ' << agg.mean << ' ' << agg.m2 << '\n';
+            }
+            if (!file.flush()) return false;
+        }
+
+        std::error_code ec;
+        fs::rename(temp_path, file_path, ec);
+        return !ec;
+    }
+
+    bool LoadAggregates(const std::string &file_path, AggregateSet &aggregates)
+    {
+        std::ifstream file(file_path);
+        if (!file) return false;
+
+        AggregateSet loaded;
+        std::string line;
+        while (std::getline(file, line))
+        {
+            if (line.empty()) continue;
+
+            std::istringstream iss(line);
+            std::string name, min, max;
+            RunningAggregate agg;
+            if (!(iss >> name >> agg.start >> agg.count >> agg.sum >> min >> max >> agg.mean >> agg.m2))
+            {
+                return false;
+            }
+            // inf/-inf пустого окна не читаются через operator>>; испорченный файл - не исключение, а свежие окна
+            if (!ParseDouble(min, agg.min) || !ParseDouble(max, agg.max))
+            {
+                return false;
+            }
+            loaded[name] = agg;
+        }
+        aggregates = loaded;
+        return true;
+    }
+}
@@ -0,0 +1,123 @@
+#ifndef AGGREGATES_HPP
+#define AGGREGATES_HPP
+
+#include <string>
+#include <map>
+#include <cstdint>
+#include <cmath>
+#include <limits>
+#include <vector>
+
+namespace tslib
+{
+    // Накопительные характеристики окна: число, сумма, минимум, максимум и дисперсия
+    // (алгоритм Уэлфорда). Добавление значения и получение итогов - O(1)
+    struct RunningAggregate
+    {
+        uint64_t count = 0;
+        double sum = 0;
+        double min = std::numeric_limits<double>::infinity();
+        double max = -std::numeric_limits<double>::infinity();
+        double mean = 0;
+        double m2 = 0; // Сумма квадратов отклонений от среднего
+        int64_t start = 0; // Начало окна (UNIX время)
+
+        void Add(double value)
+        {
+            ++count;
+            sum += value;
+            if (value < min) min = value;
+            if (value > max) max = value;
+            double delta = value - mean;
+            mean += delta / count;
+            m2 += delta * (value - mean);
+        }
+
+        // Добавляет итоги другого окна (параллельный вариант алгоритма Уэлфорда); начало окна не меняется
+        void Merge(const RunningAggregate &other)
+        {
+            if (other.count == 0) return;
+            if (count == 0)
+            {
+                int64_t window_start = start;
+                *this = other;
+                start = window_start;
+                return;
+            }
+            uint64_t total = count + other.count;
+            double delta = other.mean - mean;
+            mean += delta * other.count / total;
+            m2 += other.m2 + delta * delta * ((double)count * other.count / total);
+            count = total;
+            sum += other.sum;
+            if (other.min < min) min = other.min;
+            if (other.max > max) max = other.max;
+        }
+
+        // Начинает новое окно
+        void Reset(int64_t window_start)
+        {
+            *this = RunningAggregate();
+            start = window_start;
+        }
+
+        bool Empty() const { return count == 0; }
+        double Mean() const { return count > 0 ? mean : 0.0; }
+        double Variance() const { return count > 1 ? m2 / (count - 1) : 0.0; }
+        double StdDev() const { return std::sqrt(Variance()); }
+    };
+
+    // Интервал прореживания: характеристики записей с start <= time < start + step
+    struct Bucket
+    {
+        int64_t start;
+        RunningAggregate agg;
+        double last;
+    };
+
+    // Раскладывает возрастающие по времени записи по интервалам step секунд начиная с from
+    struct Downsampler
+    {
+        int64_t from;
+        int64_t step;
+        std::vector<Bucket> buckets; // Только непустые интервалы
+
+        Downsampler(int64_t from, int64_t step) : from(from), step(step) {}
+
+        void Add(int64_t time, double value)
+        {
+            int64_t start = from + (time - from) / step * step;
+            if (buckets.empty() || buckets.back().start != start)
+            {
+                buckets.push_back({start, RunningAggregate(), 0.0});
+                buckets.back().agg.start = start;
+            }
+            buckets.back().agg.Add(value);
+            buckets.back().last = value;
+        }
+
+        // Итоги готовой пачки записей, целиком лежащей в одном интервале; agg.start - время первой из них
+        void AddAggregate(const RunningAggregate &agg, double last)
+        {
+            int64_t start = from + (agg.start - from) / step * step;
+            if (buckets.empty() || buckets.back().start != start)
+            {
+                buckets.push_back({start, RunningAggregate(), 0.0});
+                buckets.back().agg.start = start;
+            }
+            buckets.back().agg.Merge(agg);
+            buckets.back().last = last;
+        }
+    };
+
+    // Набор именованных окон, сохраняемый в файл, чтобы пережить перезапуск
+    using AggregateSet = std::map<std::string, RunningAggregate>;
+
+    // Атомарно (через временный файл) сохраняет набор окон
+    bool SaveAggregates(const std::string &file_path, const AggregateSet &aggregates);
+
+    // Загружает набор окон; false, если файла нет или он повреждён
+    bool LoadAggregates(const std::string &file_path, AggregateSet &aggregates);
+}
+
+#endif // AGGREGATES_HPP
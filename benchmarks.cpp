@@ -0,0 +1,278 @@
+// Микробенчмарки горячих путей: разбор строк и логов, среднее по логу, дозапись в хранилища,
+// разбор HTTP запроса, выбор маршрута, сборка и сжатие ответа. Данные генерируются с фиксированным зерном, результаты
+// пишутся строками JSON (по строке на бенчмарк) для сравнения между коммитами
+#include "http_server.hpp"
+#include "general_utils.hpp"
+#include "log_parser.hpp"
+#include "time_index.hpp"
+#include "ts_storage.hpp"
+#include "segmented_log.hpp"
+#include "sensor_protocol.hpp"
+
+#include <string>
+#include <vector>
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <chrono>
+#include <random>
+#include <algorithm>
+#include <functional>
+#include <filesystem>
+
+namespace fs = std::filesystem;
+
+constexpr char BENCH_DIR[] = "bench_data";
+constexpr int64_t BENCH_START_TIME = 1700000000;
+constexpr double DEFAULT_MIN_TIME_SEC = 0.2;
+constexpr int BENCH_REPEATS = 5;
+
+// Не даёт компилятору выбросить вычисленное значение
+template <typename T>
+void KeepValue(const T& value) {
+#if defined(_MSC_VER)
+    static volatile const void* sink;
+    sink = &value;
+#else
+    asm volatile("" : : "r,m"(value) : "memory");
+#endif
+}
+
+struct BenchResult {
+    std::string name;
+    uint64_t iterations = 0;  // В одном повторе
+    double ns_per_op = 0;     // Медиана повторов
+    double min_ns_per_op = 0;
+    uint64_t items_per_op = 1; // Строк/записей на одну операцию
+};
+
+struct BenchConfig {
+    double min_time_sec = DEFAULT_MIN_TIME_SEC;
+    std::string filter;       // Подстрока имени
+    std::string label;        // Метка прогона, например хэш коммита
+    std::string out;          // Файл результатов; пусто - stdout
+};
+
+// Подбирает число итераций так, чтобы повтор шёл не меньше min_time_sec, и берёт медиану BENCH_REPEATS повторов
+BenchResult RunBench(const std::string& name, uint64_t items_per_op, const BenchConfig& config, const std::function<void()>& op) {
+    using clock = std::chrono::steady_clock;
+    auto run = [&op](uint64_t iterations) {
+        auto start = clock::now();
+        for (uint64_t i = 0; i < iterations; ++i) op();
+        return std::chrono::duration<double, std::nano>(clock::now() - start).count();
+    };
+
+    uint64_t iterations = 1;
+    double elapsed = run(iterations);
+    while (elapsed < config.min_time_sec * 1e9 && iterations < (1ull << 40)) {
+        double scale = elapsed > 0 ? config.min_time_sec * 1e9 / elapsed : 100;
+        iterations = (uint64_t)(iterations * std::clamp(scale * 1.2, 2.0, 100.0));
+        elapsed = run(iterations);
+    }
+
+    std::vector<double> per_op;
+    for (int r = 0; r < BENCH_REPEATS; ++r) {
+        per_op.push_back(run(iterations) / iterations);
+    }
+    std::sort(per_op.begin(), per_op.end());
+
+    BenchResult result;
+    result.name = name;
+    result.iterations = iterations;
+    result.ns_per_op = per_op[per_op.size() / 2];
+    result.min_ns_per_op = per_op.front();
+    result.items_per_op = items_per_op;
+    return result;
+}
+
+std::string ToJson(const BenchResult& result, const std::string& label) {
+    std::ostringstream out;
+    out.precision(6);
+    out << std::fixed << "{\"name\":\"" << result.name << "\",\"label\":\"" << label << "\",\"iterations\":" << result.iterations
+        << ",\"ns_per_op\":" << result.ns_per_op << ",\"min_ns_per_op\":" << result.min_ns_per_op
+        << ",\"items_per_op\":" << result.items_per_op << ",\"ns_per_item\":" << result.ns_per_op / result.items_per_op << "}";
+    return out.str();
+}
+
+// Лог "время значение" по секунде на строку, как у gener_t.py
+std::string GenerateLog(size_t lines, uint32_t seed) {
+    std::mt19937 rng(seed);
+    std::normal_distribution<double> noise(0, 3);
+    std::string log;
+    log.reserve(lines * 24);
+    for (size_t i = 0; i < lines; ++i) {
+        tslib::AppendTextRecord(log, BENCH_START_TIME + (int64_t)i, -5 + noise(rng));
+    }
+    return log;
+}
+
+std::string WriteLogFile(const std::string& name, size_t lines) {
+    std::string path = std::string(BENCH_DIR) + "/" + name;
+    std::ofstream(path, std::ios::binary | std::ios::trunc) << GenerateLog(lines, (uint32_t)lines);
+    return path;
+}
+
+// Прежний разбор: Trim с '$' и std::stod с исключением на ошибке
+double LegacyParseTemperature(const std::string& str) {
+    auto comp_dollar = [](int ch) -> int { return (std::isspace(ch) || ch == '$') ? 1 : 0; };
+    try {
+        return std::stod(utillib::Trim(str, comp_dollar));
+    } catch (...) {
+        return 0;
+    }
+}
+
+int main(int argc, char** argv) {
+    BenchConfig config;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        size_t eq = arg.find('=');
+        std::string key = arg.substr(0, eq);
+        std::string value = eq == std::string::npos ? "" : arg.substr(eq + 1);
+        if (key == "--filter") config.filter = value;
+        else if (key == "--label") config.label = value;
+        else if (key == "--out") config.out = value;
+        else if (key == "--min-time") config.min_time_sec = std::stod(value);
+        else {
+            std::cerr << "Usage: " << argv[0] << " [--filter=SUBSTR] [--label=NAME] [--out=FILE] [--min-time=SEC]" << std::endl;
+            return 1;
+        }
+    }
+
+    fs::remove_all(BENCH_DIR);
+    fs::create_directories(BENCH_DIR);
+
+    std::ofstream out_file;
+    if (!config.out.empty()) out_file.open(config.out, std::ios::app);
+    std::ostream& out = config.out.empty() ? std::cout : out_file;
+
+    auto bench = [&](const std::string& name, uint64_t items, const std::function<void()>& op) {
+        if (!config.filter.empty() && name.find(config.filter) == std::string::npos) return;
+        BenchResult result = RunBench(name, items, config, op);
+        out << ToJson(result, config.label) << std::endl;
+        if (!config.out.empty()) {
+            std::cerr << result.name << ": " << result.ns_per_op << " ns/op" << std::endl;
+        }
+    };
+
+    // Строки
+    const std::string log_line = "1700000000 -12.34567";
+    const std::string temp_frame = "$-6.87$\r";
+    bench("utillib_split_line", 1, [&] { KeepValue(utillib::Split(log_line, " ")); });
+    bench("utillib_trim_frame", 1, [&] {
+        KeepValue(utillib::Trim(temp_frame, [](int ch) -> int { return (std::isspace(ch) || ch == '$') ? 1 : 0; }));
+    });
+    bench("parse_temperature_legacy", 1, [&] { KeepValue(LegacyParseTemperature(temp_frame)); });
+    bench("parse_temperature", 1, [&] {
+        double value = 0;
+        KeepValue(tslib::ParseTemperature(temp_frame, value));
+        KeepValue(value);
+    });
+    bench("parse_log_line", 1, [&] {
+        int64_t time = 0;
+        double value = 0;
+        KeepValue(tslib::ParseLogLine(log_line, time, value));
+        KeepValue(value);
+    });
+
+    // Разбор суточного лога целиком
+    const size_t day_lines = 86400;
+    const std::string day_log = GenerateLog(day_lines, 1);
+    bench("split_log_day_legacy", day_lines, [&] {
+        double sum = 0;
+        std::istringstream in(day_log);
+        std::string line;
+        while (std::getline(in, line)) {
+            auto parts = utillib::Split(line, " ");
+            if (parts.size() < 2) continue;
+            KeepValue(std::stoll(parts[0]));
+            sum += std::stod(parts[1]);
+        }
+        KeepValue(sum);
+    });
+    tslib::LogColumns columns;
+    bench("scan_log_buffer_day", day_lines, [&] {
+        columns.Clear();
+        tslib::ScanLogBuffer(day_log, columns);
+        KeepValue(columns.values.data());
+    });
+
+    // Среднее за последний час по логам разного размера (индекс строится при первом вызове)
+    for (size_t lines : {size_t(3600), size_t(86400), size_t(864000)}) {
+        std::string path = WriteLogFile("mean_" + std::to_string(lines) + ".log", lines);
+        int64_t now = BENCH_START_TIME + (int64_t)lines - 1;
+        tslib::GetMeanTemp(path, now, 3600);
+        bench("get_mean_temp_hour_of_" + std::to_string(lines), 3600, [&] { KeepValue(tslib::GetMeanTemp(path, now, 3600)); });
+    }
+
+    // Дозапись измерений (замена прежнего WriteTempToFile)
+    {
+        tslib::Series series;
+        series.Open(std::string(BENCH_DIR) + "/series", 3600);
+        int64_t time = BENCH_START_TIME;
+        bench("series_append", 1, [&] { series.Append(time++, 21.5); });
+    }
+    {
+        tslib::SegmentedLog log;
+        log.Open(std::string(BENCH_DIR) + "/segmented", 86400, 0);
+        int64_t time = BENCH_START_TIME;
+        bench("segmented_log_append", 1, [&] { log.Append(time++, 21.5); });
+    }
+
+    // Двоичный протокол датчика: пакет из 50 измерений
+    {
+        splib::SensorPacket packet;
+        for (int i = 0; i < 50; ++i) packet.values.push_back(-5 + i * 0.01);
+        std::string frame = splib::EncodeSensorPacket(packet);
+        std::string encoded(frame.data(), frame.size() - 1);
+        std::string raw;
+        splib::SensorPacket decoded;
+        bench("sensor_packet_decode_50", 50, [&] {
+            splib::CobsDecode(encoded, raw);
+            KeepValue(splib::ParseSensorPacket(raw, decoded));
+        });
+    }
+
+    // HTTP: разбор запроса и сборка ответа
+    const std::string request_data =
+        "GET /series?from=1700000000&to=1700086400&step=300&agg=mean HTTP/1.1\r\n"
+        "Host: 127.0.0.1:8080\r\n"
+        "User-Agent: Mozilla/5.0 (X11; Linux x86_64)\r\n"
+        "Accept: */*\r\n"
+        "Accept-Encoding: gzip, deflate\r\n"
+        "Connection: keep-alive\r\n\r\n";
+    bench("http_request_parse", 1, [&] {
+        srvlib::Request request(request_data);
+        KeepValue(request.GetArg("step"));
+    });
+    // Только разбор над буфером соединения, без копирования запроса
+    srvlib::RequestParser parser;
+    bench("http_request_parser", 1, [&] {
+        parser.Reset();
+        KeepValue(parser.Parse(request_data));
+    });
+    {
+        // Маршруты как у сервера; запрос попадает в последний точный маршрут и в маршрут с параметром
+        srvlib::Router router;
+        auto handler = [](const srvlib::Request&, srvlib::ResponseWriter&) {};
+        for (const char* path : {"/all", "/hour", "/day", "/sensors", "/ingest", "/metrics", "/stream", "/series"}) {
+            router.Add("GET", path, handler);
+        }
+        router.Add("GET", "/sensors/:id/series", handler);
+        srvlib::Request request(request_data);
+        bench("http_route_match_exact", 1, [&] { KeepValue(router.Match(request)); });
+        srvlib::Request param_request("GET /sensors/ttyUSB0/series?step=300 HTTP/1.1\r\n\r\n");
+        bench("http_route_match_param", 1, [&] { KeepValue(router.Match(param_request)); });
+    }
+    const std::string body = day_log.substr(0, 1024);
+    srvlib::Response response("200 OK", "text/plain");
+    bench("http_response_get_answer_1k", 1, [&] { KeepValue(response.GetAnswer(body)); });
+    const std::string hour_log = day_log.substr(0, 64 * 1024);
+    std::string encoded;
+    bench("http_gzip_dynamic_64k", 1, [&] {
+        KeepValue(srvlib::EncodeBody(hour_log, srvlib::ENCODING_GZIP, COMPRESS_LEVEL_DYNAMIC, encoded));
+    });
+
+    fs::remove_all(BENCH_DIR);
+    return 0;
+}
@@ -0,0 +1,407 @@
+#include "compressed_segment.hpp"
+
+#include <bit>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <filesystem>
+
+namespace fs = std::filesystem;
+
+namespace tslib
+{
+    // Запись битов старшими вперёд
+    class BitWriter
+    {
+    public:
+        explicit BitWriter(std::string &out) : m_out(out) {}
+
+        // Младшие count (1..64) бит value
+        void Write(uint64_t value, int count)
+        {
+            while (count > 0)
+            {
+                int n = std::min(count, 64 - m_bits);
+                uint64_t chunk = value >> (count - n);
+                if (n < 64) chunk &= (1ull << n) - 1;
+                m_acc = n == 64 ? chunk : (m_acc << n) | chunk;
+                m_bits += n;
+                count -= n;
+                if (m_bits == 64) Flush();
+            }
+        }
+
+        // Дописывает неполный байт нулями
+        void Finish()
+        {
+            if (m_bits == 0) return;
+            int bytes = (m_bits + 7) / 8;
+            m_acc <<= bytes * 8 - m_bits;
+            for (int i = bytes - 1; i >= 0; --i)
+            {
+                m_out.push_back((char)(m_acc >> (i * 8)));
+            }
+            m_acc = 0;
+            m_bits = 0;
+        }
+
+    private:
+        void Flush()
+        {
+            for (int i = 7; i >= 0; --i)
+            {
+                m_out.push_back((char)(m_acc >> (i * 8)));
+            }
+            m_acc = 0;
+            m_bits = 0;
+        }
+
+        std::string &m_out;
+        uint64_t m_acc = 0;
+        int m_bits = 0; // Бит в m_acc
+    };
+
+    class BitReader
+    {
+    public:
+        BitReader(const uint8_t *data, size_t size) : m_data(data), m_size_bits(size * 8) {}
+
+        // count (1..64) бит; за концом данных - 0 и признак ошибки
+        uint64_t Read(int count)
+        {
+            if (count > 56)
+            {
+                uint64_t high = Read(count - 32);
+                return (high << 32) | Read(32);
+            }
+            if (m_pos + count > m_size_bits)
+            {
+                m_error = true;
+                return 0;
+            }
+
+            // 8 байт начиная с текущего: после сдвига на смещение в байте остаётся не меньше 56 бит
+            size_t byte = m_pos >> 3;
+            size_t size = m_size_bits >> 3;
+            uint64_t window = 0;
+            if (byte + 8 <= size)
+            {
+                for (int i = 0; i < 8; ++i) window = (window << 8) | m_data[byte + i];
+            }
+            else
+            {
+                for (size_t i = 0; i < 8; ++i) window = (window << 8) | (byte + i < size ? m_data[byte + i] : 0);
+            }
+            window <<= (m_pos & 7);
+            m_pos += count;
+            return window >> (64 - count);
+        }
+
+        bool Error() const { return m_error; }
+
+    private:
+        const uint8_t *m_data;
+        size_t m_size_bits;
+        size_t m_pos = 0;
+        bool m_error = false;
+    };
+
+    static uint64_t DoubleBits(double value)
+    {
+        uint64_t bits;
+        memcpy(&bits, &value, sizeof(bits));
+        return bits;
+    }
+
+    static double BitsDouble(uint64_t bits)
+    {
+        double value;
+        memcpy(&value, &bits, sizeof(value));
+        return value;
+    }
+
+    // Разность (разностей времени или целых значений): 0 - '0', малые - префикс и 7/9/12 бит со смещением,
+    // остальные - 64 бита
+    static void WriteDelta(BitWriter &writer, int64_t dod)
+    {
+        if (dod == 0)
+        {
+            writer.Write(0, 1);
+        }
+        else if (dod >= -63 && dod <= 64)
+        {
+            writer.Write(0b10, 2);
+            writer.Write((uint64_t)(dod + 63), 7);
+        }
+        else if (dod >= -255 && dod <= 256)
+        {
+            writer.Write(0b110, 3);
+            writer.Write((uint64_t)(dod + 255), 9);
+        }
+        else if (dod >= -2047 && dod <= 2048)
+        {
+            writer.Write(0b1110, 4);
+            writer.Write((uint64_t)(dod + 2047), 12);
+        }
+        else
+        {
+            writer.Write(0b1111, 4);
+            writer.Write((uint64_t)dod, 64);
+        }
+    }
+
+    static int64_t ReadDelta(BitReader &reader)
+    {
+        if (reader.Read(1) == 0) return 0;
+        if (reader.Read(1) == 0) return (int64_t)reader.Read(7) - 63;
+        if (reader.Read(1) == 0) return (int64_t)reader.Read(9) - 255;
+        if (reader.Read(1) == 0) return (int64_t)reader.Read(12) - 2047;
+        return (int64_t)reader.Read(64);
+    }
+
+    // Состояние XOR-кодирования значений: окно значащих битов предыдущего значения
+    struct XorState
+    {
+        uint64_t prev = 0;
+        int leading = -1; // -1 - окна ещё нет
+        int trailing = 0;
+    };
+
+    // XOR с предыдущим: 0 - '0'; '10' - значащие биты в прежнем окне; '11' - 5 бит ведущих нулей,
+    // 6 бит длины (64 хранится как 0) и значащие биты
+    static void WriteValue(BitWriter &writer, XorState &state, uint64_t bits)
+    {
+        uint64_t x = bits ^ state.prev;
+        state.prev = bits;
+        if (x == 0)
+        {
+            writer.Write(0, 1);
+            return;
+        }
+
+        int leading = std::min(std::countl_zero(x), 31);
+        int trailing = std::countr_zero(x);
+        if (state.leading >= 0 && leading >= state.leading && trailing >= state.trailing)
+        {
+            writer.Write(0b10, 2);
+            writer.Write(x >> state.trailing, 64 - state.leading - state.trailing);
+            return;
+        }
+
+        int meaningful = 64 - leading - trailing;
+        writer.Write(0b11, 2);
+        writer.Write((uint64_t)leading, 5);
+        writer.Write((uint64_t)(meaningful & 63), 6);
+        writer.Write(x >> trailing, meaningful);
+        state.leading = leading;
+        state.trailing = trailing;
+    }
+
+    static uint64_t ReadValue(BitReader &reader, XorState &state)
+    {
+        if (reader.Read(1) == 0) return state.prev;
+
+        if (reader.Read(1) == 1)
+        {
+            state.leading = (int)reader.Read(5);
+            int meaningful = (int)reader.Read(6);
+            if (meaningful == 0) meaningful = 64;
+            state.trailing = 64 - state.leading - meaningful;
+            if (state.trailing < 0)
+            {
+                state.trailing = 0;
+                reader.Read(64); // Повреждённые данные: дочитываем до ошибки
+                return state.prev;
+            }
+        }
+        else if (state.leading < 0)
+        {
+            reader.Read(64);
+            return state.prev;
+        }
+
+        int meaningful = 64 - state.leading - state.trailing;
+        state.prev ^= reader.Read(meaningful) << state.trailing;
+        return state.prev;
+    }
+
+    RunningAggregate GetBlockAggregate(const BlockHeader &header)
+    {
+        RunningAggregate agg;
+        agg.count = header.count;
+        agg.sum = header.sum;
+        agg.min = header.min;
+        agg.max = header.max;
+        agg.mean = header.mean;
+        agg.m2 = header.m2;
+        agg.start = header.first_time;
+        return agg;
+    }
+
+    static const double POW10[] = {1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6};
+
+    // Наименьшее число знаков, при котором все значения точно (побитово) получаются как целое / 10^decimals;
+    // -1 - такого нет
+    static int FindDecimals(const Record *begin, const Record *end)
+    {
+        for (int decimals = 0; decimals <= COMPRESSED_MAX_DECIMALS; ++decimals)
+        {
+            bool exact = true;
+            for (const Record *rec = begin; exact && rec != end; ++rec)
+            {
+                double scaled = std::round(rec->value * POW10[decimals]);
+                exact = std::abs(scaled) < 1e15 && DoubleBits(scaled / POW10[decimals]) == DoubleBits(rec->value);
+            }
+            if (exact) return decimals;
+        }
+        return -1;
+    }
+
+    static void AppendBlock(std::string &out, const Record *begin, const Record *end)
+    {
+        RunningAggregate agg;
+        for (const Record *rec = begin; rec != end; ++rec)
+        {
+            agg.Add(rec->value);
+        }
+
+        BlockHeader header = {};
+        header.count = (uint16_t)(end - begin);
+        header.first_time = begin->time;
+        header.last_time = (end - 1)->time;
+        header.first_value = begin->value;
+        header.last_value = (end - 1)->value;
+        header.sum = agg.sum;
+        header.min = agg.min;
+        header.max = agg.max;
+        header.mean = agg.mean;
+        header.m2 = agg.m2;
+
+        int decimals = FindDecimals(begin, end);
+        header.encoding = decimals >= 0 ? BLOCK_DECIMAL : BLOCK_XOR;
+        header.decimals = (uint8_t)std::max(decimals, 0);
+
+        std::string payload;
+        BitWriter writer(payload);
+        XorState state;
+        state.prev = DoubleBits(begin->value);
+        int64_t prev_scaled = decimals >= 0 ? (int64_t)std::round(begin->value * POW10[decimals]) : 0;
+        int64_t prev_delta = 0;
+        for (const Record *rec = begin + 1; rec != end; ++rec)
+        {
+            int64_t delta = rec->time - (rec - 1)->time;
+            WriteDelta(writer, delta - prev_delta);
+            prev_delta = delta;
+            if (decimals >= 0)
+            {
+                int64_t scaled = (int64_t)std::round(rec->value * POW10[decimals]);
+                WriteDelta(writer, scaled - prev_scaled);
+                prev_scaled = scaled;
+            }
+            else
+            {
+                WriteValue(writer, state, DoubleBits(rec->value));
+            }
+        }
+        writer.Finish();
+
+        header.payload_size = (uint32_t)payload.size();
+        out.append((const char *)&header, sizeof(header));
+        out.append(payload);
+    }
+
+    bool WriteCompressedSegment(const std::string &path, int64_t segment_start, const Record *begin, const Record *end)
+    {
+        std::string data(COMPRESSED_SEGMENT_MAGIC, 8);
+        data.append((const char *)&segment_start, sizeof(segment_start));
+        for (const Record *block = begin; block != end;)
+        {
+            const Record *block_end = end - block > COMPRESSED_BLOCK_RECORDS ? block + COMPRESSED_BLOCK_RECORDS : end;
+            AppendBlock(data, block, block_end);
+            block = block_end;
+        }
+
+        std::string temp_path = path + ".tmp";
+        {
+            std::ofstream file(temp_path, std::ios::binary | std::ios::trunc);
+            if (!file.write(data.data(), (std::streamsize)data.size()) || !file.flush()) return false;
+        }
+
+        std::error_code ec;
+        fs::rename(temp_path, path, ec);
+        return !ec;
+    }
+
+    bool CompressedSegment::Open(const std::string &path)
+    {
+        m_data.clear();
+        m_blocks.clear();
+
+        std::ifstream file(path, std::ios::binary);
+        if (!file) return false;
+        m_data.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+        if (m_data.size() < SEGMENT_HEADER_SIZE || memcmp(m_data.data(), COMPRESSED_SEGMENT_MAGIC, 8) != 0)
+        {
+            m_data.clear();
+            return false;
+        }
+
+        size_t offset = SEGMENT_HEADER_SIZE;
+        while (m_data.size() - offset >= sizeof(BlockHeader))
+        {
+            BlockInfo info;
+            memcpy(&info.header, m_data.data() + offset, sizeof(BlockHeader));
+            info.payload_offset = offset + sizeof(BlockHeader);
+            if (info.header.count == 0 || m_data.size() - info.payload_offset < info.header.payload_size) break;
+
+            m_blocks.push_back(info);
+            offset = info.payload_offset + info.header.payload_size;
+        }
+        return true;
+    }
+
+    bool CompressedSegment::DecodeBlock(size_t block, std::vector<Record> &records) const
+    {
+        const BlockInfo &info = m_blocks[block];
+        BitReader reader((const uint8_t *)m_data.data() + info.payload_offset, info.header.payload_size);
+
+        bool decimal = info.header.encoding == BLOCK_DECIMAL;
+        if ((!decimal && info.header.encoding != BLOCK_XOR) || info.header.decimals > COMPRESSED_MAX_DECIMALS) return false;
+        double scale = POW10[info.header.decimals];
+
+        XorState state;
+        state.prev = DoubleBits(info.header.first_value);
+        int64_t scaled = decimal ? (int64_t)std::round(info.header.first_value * scale) : 0;
+        int64_t time = info.header.first_time;
+        int64_t delta = 0;
+        records.push_back({time, info.header.first_value});
+        for (uint32_t i = 1; i < info.header.count; ++i)
+        {
+            delta += ReadDelta(reader);
+            time += delta;
+            double value = 0;
+            if (decimal)
+            {
+                scaled += ReadDelta(reader);
+                value = scaled / scale;
+            }
+            else
+            {
+                value = BitsDouble(ReadValue(reader, state));
+            }
+            if (reader.Error()) return false;
+            records.push_back({time, value});
+        }
+        return true;
+    }
+
+    size_t CompressedSegment::Size() const
+    {
+        size_t count = 0;
+        for (const auto &info : m_blocks)
+        {
+            count += info.header.count;
+        }
+        return count;
+    }
+}
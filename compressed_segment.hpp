@@ -0,0 +1,83 @@
+#ifndef COMPRESSED_SEGMENT_HPP
+#define COMPRESSED_SEGMENT_HPP
+
+#include <string>
+#include <vector>
+#include <cstdint>
+
+#include "aggregates.hpp"
+#include "ts_storage.hpp"
+
+namespace tslib
+{
+#define COMPRESSED_SEGMENT_MAGIC "TSDBGOR1"
+#define COMPRESSED_SEGMENT_EXTENSION ".gseg"
+#define COMPRESSED_BLOCK_RECORDS 256
+#define COMPRESSED_MAX_DECIMALS 6
+
+    // Кодирование значений блока
+    enum BlockEncoding
+    {
+        BLOCK_XOR = 0,    // XOR с предыдущим значением (Gorilla)
+        BLOCK_DECIMAL = 1 // Все значения - десятичные дроби с decimals знаками: разности целых значение * 10^decimals
+    };
+
+    // Заголовок блока: границы и итоги блока, чтобы отбирать и агрегировать блоки без распаковки
+    struct BlockHeader
+    {
+        uint32_t payload_size; // Байт сжатых данных после заголовка
+        uint16_t count;
+        uint8_t encoding; // BlockEncoding
+        uint8_t decimals;
+        int64_t first_time;
+        int64_t last_time;
+        double first_value;
+        double last_value;
+        double sum;
+        double min;
+        double max;
+        double mean;
+        double m2;
+    };
+    static_assert(sizeof(BlockHeader) == 80, "BlockHeader must be 80 bytes");
+
+    // Итоги блока в виде окна агрегатов
+    RunningAggregate GetBlockAggregate(const BlockHeader &header);
+
+    // Сжатый запечатанный сегмент ряда в формате Gorilla: заголовок (магическое слово, начало сегмента)
+    // и блоки до COMPRESSED_BLOCK_RECORDS записей. Каждый блок распаковывается независимо:
+    // первые время и значение - в заголовке блока, дальше время как разность разностей,
+    // а значение как XOR с предыдущим (совпадающие старшие и младшие нулевые биты не хранятся).
+    // Показания датчиков - короткие десятичные дроби, у которых XOR почти не сокращается, поэтому
+    // блок, все значения которого точно восстанавливаются из целого / 10^decimals, хранит разности этих целых
+    class CompressedSegment
+    {
+    public:
+        // Читает файл сегмента и заголовки блоков
+        bool Open(const std::string &path);
+
+        size_t GetBlockCount() const { return m_blocks.size(); }
+        const BlockHeader &GetBlock(size_t block) const { return m_blocks[block].header; }
+
+        // Распаковывает записи блока (дописывая в records); false - блок повреждён
+        bool DecodeBlock(size_t block, std::vector<Record> &records) const;
+
+        // Число записей во всех блоках
+        size_t Size() const;
+
+    private:
+        struct BlockInfo
+        {
+            BlockHeader header;
+            size_t payload_offset;
+        };
+
+        std::vector<char> m_data;
+        std::vector<BlockInfo> m_blocks;
+    };
+
+    // Сжимает записи (по возрастанию времени) в файл сегмента; пишет через временный файл и переименование
+    bool WriteCompressedSegment(const std::string &path, int64_t segment_start, const Record *begin, const Record *end);
+}
+
+#endif // COMPRESSED_SEGMENT_HPP
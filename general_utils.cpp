@@ -97,4 +97,48 @@ namespace utillib
         }
         return result;
     }
+
+    ThreadPool::ThreadPool(size_t thread_count)
+    {
+        if (thread_count == 0) thread_count = 1;
+        for (size_t i = 0; i < thread_count; ++i) {
+            m_threads.emplace_back(&ThreadPool::WorkerLoop, this);
+        }
+    }
+
+    ThreadPool::~ThreadPool()
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_stop = true;
+        }
+        m_cv.notify_all();
+        for (auto &thread : m_threads) {
+            thread.join();
+        }
+    }
+
+    void ThreadPool::Push(std::function<void()> task)
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_tasks.push_back(std::move(task));
+        }
+        m_cv.notify_one();
+    }
+
+    void ThreadPool::WorkerLoop()
+    {
+        while (true) {
+            std::function<void()> task;
+            {
+                std::unique_lock<std::mutex> lock(m_mutex);
+                m_cv.wait(lock, [this] { return m_stop || !m_tasks.empty(); });
+                if (m_stop && m_tasks.empty()) return;
+                task = std::move(m_tasks.front());
+                m_tasks.pop_front();
+            }
+            task();
+        }
+    }
 }
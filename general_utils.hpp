@@ -10,6 +10,11 @@
 #include <memory>
 #include <iostream>
 #include <stdexcept>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <deque>
 
 namespace utillib
 {
@@ -36,6 +41,31 @@ namespace utillib
 
     // Выполняет команду в командной строке и возвращает ответ команды либо "ERROR"
     std::string Exec(const char* cmd);
+
+    // Пул потоков, выполняющий задачи из общей очереди
+    class ThreadPool
+    {
+    public:
+        explicit ThreadPool(size_t thread_count);
+        ~ThreadPool();
+
+        ThreadPool(const ThreadPool &) = delete;
+        ThreadPool &operator=(const ThreadPool &) = delete;
+
+        // Добавляет задачу в очередь
+        void Push(std::function<void()> task);
+
+        size_t Size() const { return m_threads.size(); }
+
+    private:
+        void WorkerLoop();
+
+        std::vector<std::thread> m_threads;
+        std::deque<std::function<void()>> m_tasks;
+        std::mutex m_mutex;
+        std::condition_variable m_cv;
+        bool m_stop = false;
+    };
 }
 
 #endif // UTILITY_HPP
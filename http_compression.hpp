@@ -0,0 +1,314 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <functional>
+#include <unordered_map>
+#include <list>
+#include <cstdint>
+#include <cstdlib>
+#include <cctype>
+
+#include "metrics.hpp"
+
+#ifdef SRVLIB_ZLIB
+#include <zlib.h>
+#endif
+
+namespace srvlib
+{
+#define COMPRESS_MIN_SIZE 1024 // Меньшие тела отдаются как есть
+#define COMPRESS_LEVEL_CACHED 9 // Кэшируемое сжимается один раз, поэтому сильнее
+#define COMPRESS_LEVEL_DYNAMIC 1 // Тела, собираемые на каждый запрос
+#define COMPRESS_CACHE_MAX_SIZE (64 * 1024 * 1024) // Байт сжатых кусков в кэше
+#define COMPRESS_MAX_FILE_SIZE (64 * 1024 * 1024) // Файлы больше отдаются через sendfile без сжатия
+
+    // Кодирование тела ответа (Content-Encoding)
+    enum ContentEncoding
+    {
+        ENCODING_IDENTITY,
+        ENCODING_GZIP,
+        ENCODING_DEFLATE // zlib-поток (RFC 1950), как его понимают браузеры
+    };
+
+    inline const char *GetEncodingName(ContentEncoding encoding)
+    {
+        switch (encoding)
+        {
+        case ENCODING_GZIP:
+            return "gzip";
+        case ENCODING_DEFLATE:
+            return "deflate";
+        default:
+            return "identity";
+        }
+    }
+
+    // Кодирование по заголовку Accept-Encoding: из gzip и deflate - с большим q (при равных - gzip),
+    // q=0 запрещает, "*" разрешает оба. Без zlib - всегда identity
+    inline ContentEncoding SelectEncoding(const std::string &accept)
+    {
+#ifdef SRVLIB_ZLIB
+        double gzip_q = -1, deflate_q = -1, any_q = -1;
+        size_t start = 0;
+        while (start < accept.size())
+        {
+            size_t end = accept.find(',', start);
+            if (end == std::string::npos) end = accept.size();
+            std::string item = accept.substr(start, end - start);
+            start = end + 1;
+
+            double q = 1;
+            size_t semicolon = item.find(';');
+            if (semicolon != std::string::npos)
+            {
+                size_t q_pos = item.find("q=", semicolon);
+                if (q_pos != std::string::npos) q = std::strtod(item.c_str() + q_pos + 2, NULL);
+                item.resize(semicolon);
+            }
+            std::string name;
+            for (char ch : item)
+            {
+                if (ch != ' ' && ch != '\t') name += (char)std::tolower((unsigned char)ch);
+            }
+
+            if (name == "gzip" || name == "x-gzip") gzip_q = q;
+            else if (name == "deflate") deflate_q = q;
+            else if (name == "*") any_q = q;
+        }
+        if (gzip_q < 0) gzip_q = any_q;
+        if (deflate_q < 0) deflate_q = any_q;
+
+        if (gzip_q > 0 && gzip_q >= deflate_q) return ENCODING_GZIP;
+        if (deflate_q > 0) return ENCODING_DEFLATE;
+#else
+        (void)accept;
+#endif
+        return ENCODING_IDENTITY;
+    }
+
+    // Сжимать имеет смысл текст; картинки, шрифты и архивы уже сжаты
+    inline bool IsCompressibleType(const std::string &content_type)
+    {
+        return content_type.starts_with("text/") || content_type == "application/json" ||
+               content_type == "application/xml" || content_type == "image/svg+xml" ||
+               content_type == "application/wasm";
+    }
+
+    // Независимо сжатый кусок потока deflate, закрытый Z_SYNC_FLUSH (без последнего блока).
+    // Такие куски склеиваются в один поток, а их контрольные суммы - через crc32_combine/adler32_combine,
+    // так что тело из неизменных частей собирается без повторного сжатия
+    struct DeflateChunk
+    {
+        std::string data;
+        uint32_t crc = 0; // crc32 исходных данных (для gzip)
+        uint32_t adler = 1; // adler32 исходных данных (для deflate)
+        size_t size = 0; // Байт исходных данных
+    };
+
+    // false - zlib недоступна или ошибка сжатия
+    inline bool CompressChunk(const std::string &text, int level, DeflateChunk &chunk)
+    {
+#ifdef SRVLIB_ZLIB
+        z_stream stream = {};
+        if (deflateInit2(&stream, level, Z_DEFLATED, -MAX_WBITS, 8, Z_DEFAULT_STRATEGY) != Z_OK)
+        {
+            return false;
+        }
+
+        chunk.data.resize(deflateBound(&stream, text.size()) + 16);
+        stream.next_in = (Bytef *)text.data();
+        stream.avail_in = (uInt)text.size();
+        int result = Z_OK;
+        do
+        {
+            if (stream.total_out == chunk.data.size()) chunk.data.resize(chunk.data.size() * 2);
+            stream.next_out = (Bytef *)chunk.data.data() + stream.total_out;
+            stream.avail_out = (uInt)(chunk.data.size() - stream.total_out);
+            result = deflate(&stream, Z_SYNC_FLUSH);
+        } while (result == Z_OK && stream.avail_out == 0);
+        chunk.data.resize(stream.total_out);
+        deflateEnd(&stream);
+        if (result != Z_OK && result != Z_BUF_ERROR)
+        {
+            return false;
+        }
+
+        chunk.crc = (uint32_t)crc32(0, (const Bytef *)text.data(), (uInt)text.size());
+        chunk.adler = (uint32_t)adler32(1, (const Bytef *)text.data(), (uInt)text.size());
+        chunk.size = text.size();
+        return true;
+#else
+        (void)text;
+        (void)level;
+        (void)chunk;
+        return false;
+#endif
+    }
+
+    // Тело в кодировке encoding из кусков по порядку: заголовок формата, куски, пустой последний блок
+    // deflate и контрольная сумма
+    inline std::string BuildEncodedBody(const std::vector<std::shared_ptr<const DeflateChunk>> &chunks, ContentEncoding encoding)
+    {
+        std::string body;
+#ifdef SRVLIB_ZLIB
+        size_t data_size = 0;
+        for (const auto &chunk : chunks) data_size += chunk->data.size();
+        body.reserve(data_size + 20);
+
+        if (encoding == ENCODING_GZIP)
+        {
+            body.append("\x1f\x8b\x08\x00\x00\x00\x00\x00\x00\x03", 10); // Без имени и времени, ОС - Unix
+        }
+        else
+        {
+            body.append("\x78\x9c", 2);
+        }
+
+        uLong crc = 0, adler = 1;
+        size_t size = 0;
+        for (const auto &chunk : chunks)
+        {
+            body.append(chunk->data);
+            crc = crc32_combine(crc, chunk->crc, (z_off_t)chunk->size);
+            adler = adler32_combine(adler, chunk->adler, (z_off_t)chunk->size);
+            size += chunk->size;
+        }
+        body.append("\x03\x00", 2); // Последний блок с фиксированными кодами, пустой
+
+        auto append_u32 = [&body](uint32_t value, bool big_endian)
+        {
+            for (int i = 0; i < 4; ++i)
+            {
+                int shift = big_endian ? (3 - i) * 8 : i * 8;
+                body.push_back((char)(value >> shift));
+            }
+        };
+        if (encoding == ENCODING_GZIP)
+        {
+            append_u32((uint32_t)crc, false);
+            append_u32((uint32_t)size, false); // Размер по модулю 2^32
+        }
+        else
+        {
+            append_u32((uint32_t)adler, true);
+        }
+#else
+        (void)chunks;
+        (void)encoding;
+#endif
+        return body;
+    }
+
+    // Сжимает тело целиком; false - сжать не удалось, отдавать как есть
+    inline bool EncodeBody(const std::string &body, ContentEncoding encoding, int level, std::string &out)
+    {
+        auto chunk = std::make_shared<DeflateChunk>();
+        if (encoding == ENCODING_IDENTITY || !CompressChunk(body, level, *chunk))
+        {
+            return false;
+        }
+        out = BuildEncodedBody({chunk}, encoding);
+        return true;
+    }
+
+    // Часть тела ответа. Часть с непустым key неизменна (запечатанный сегмент лога и т.п.),
+    // её сжатый кусок кэшируется по key, и text вызывается только для несжатого ответа или при промахе
+    struct BodyPart
+    {
+        std::string key;
+        std::function<std::string()> text;
+    };
+
+    // Кэш сжатых кусков по ключу и версии (для файлов - размер и время изменения). Только для неизменных
+    // данных: кусок сжимается сильным уровнем в расчёте на много попаданий.
+    // Сжатие идёт без блокировки, так что один кусок могут изредка сжать два потока одновременно.
+    // При превышении COMPRESS_CACHE_MAX_SIZE вытесняются давно не использованные куски
+    class CompressionCache
+    {
+    public:
+        CompressionCache()
+            : m_hits(utillib::Metrics().GetCounter("http_compression_cache_hits_total", "Compressed parts served from the cache.")),
+              m_misses(utillib::Metrics().GetCounter("http_compression_cache_misses_total", "Compressed parts built on request."))
+        {
+        }
+
+        CompressionCache(const CompressionCache &) = delete;
+        CompressionCache &operator=(const CompressionCache &) = delete;
+
+        // Сжатый кусок для key той же версии или nullptr, если сжать не удалось
+        std::shared_ptr<const DeflateChunk> Get(const std::string &key, const std::string &version,
+                                                const std::function<std::string()> &text)
+        {
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                auto it = m_entries.find(key);
+                if (it != m_entries.end() && it->second.version == version)
+                {
+                    m_lru.splice(m_lru.begin(), m_lru, it->second.lru);
+                    m_hits.Add();
+                    return it->second.chunk;
+                }
+            }
+
+            m_misses.Add();
+            auto chunk = std::make_shared<DeflateChunk>();
+            if (!CompressChunk(text(), COMPRESS_LEVEL_CACHED, *chunk))
+            {
+                return nullptr;
+            }
+            if (chunk->data.size() > COMPRESS_CACHE_MAX_SIZE / 4)
+            {
+                return chunk; // Слишком большой для кэша
+            }
+
+            std::lock_guard<std::mutex> lock(m_mutex);
+            auto [it, inserted] = m_entries.try_emplace(key);
+            Entry &entry = it->second;
+            if (inserted)
+            {
+                m_lru.push_front(key);
+            }
+            else
+            {
+                m_size -= entry.chunk->data.size();
+                m_lru.splice(m_lru.begin(), m_lru, entry.lru);
+            }
+            entry.version = version;
+            entry.chunk = chunk;
+            entry.lru = m_lru.begin();
+            m_size += chunk->data.size();
+            Evict();
+            return chunk;
+        }
+
+    private:
+        struct Entry
+        {
+            std::string version;
+            std::shared_ptr<const DeflateChunk> chunk;
+            std::list<std::string>::iterator lru; // Место ключа в m_lru
+        };
+
+        // Вытесняет с конца списка: O(1) на кусок
+        void Evict()
+        {
+            while (m_size > COMPRESS_CACHE_MAX_SIZE && !m_lru.empty())
+            {
+                auto it = m_entries.find(m_lru.back());
+                m_size -= it->second.chunk->data.size();
+                m_entries.erase(it);
+                m_lru.pop_back();
+            }
+        }
+
+        std::mutex m_mutex;
+        std::unordered_map<std::string, Entry> m_entries;
+        std::list<std::string> m_lru; // Ключи от недавно использованных к давним
+        size_t m_size = 0;
+        utillib::Counter &m_hits;
+        utillib::Counter &m_misses;
+    };
+}
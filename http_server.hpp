@@ -7,8 +7,18 @@
 #include <filesystem>
 #include <fstream>
 #include <unordered_map>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <atomic>
+#include <algorithm>
+#include <functional>
+#include <string_view>
+#include <optional>
 
 #include "general_utils.hpp"
+#include "metrics.hpp"
+#include "http_compression.hpp"
 
 #ifdef WIN32
 #include <winsock2.h> 
@@ -23,6 +33,12 @@
 #include <poll.h>  
 #include <signal.h>
 #include <string.h> 
+#include <fcntl.h>
+#include <sys/epoll.h>
+#include <sys/inotify.h>
+#include <sys/uio.h>
+#include <sys/sendfile.h>
+#include <sys/eventfd.h>
 #define SOCKET int
 #define INVALID_SOCKET -1
 #define SOCKET_ERROR -1
@@ -31,49 +47,138 @@
 namespace srvlib
 {
 #define READ_WAIT_MS 50
+#define WRITE_WAIT_MS 5000 // Клиент, не забирающий ответ дольше, отключается
+#define MAX_REQUEST_SIZE 65536
+#define MAX_REQUEST_LINE 8192 // Байт в строке запроса (метод, адрес, версия)
+#define MAX_HEADER_LINE 8192
+#define MAX_HEADERS 64
+#define MAX_URL_ARGS 64
+#define EPOLL_MAX_EVENTS 256
+#define DEFAULT_WORKER_COUNT 4
+#define KEEP_ALIVE_TIMEOUT_SEC 5
+#define KEEP_ALIVE_MAX_REQUESTS 100
+#define IDLE_SWEEP_MS 1000
 #define DEFAULT_HTTP_VERSION "HTTP/1.1"
     namespace fs = std::filesystem;
 
-    std::string GetMimeType(const std::string &filename)
+#define DEFAULT_MIME_TYPE "application/unknown"
+#define STATIC_CACHE_MAX_FILE_SIZE (8 * 1024 * 1024)
+#define STREAM_RING_SIZE 4096 // Событий в кольце EventStream
+#define STREAM_MAX_BATCH 256 // Событий за одну отправку подписчику
+#define STREAM_PING_SEC 15 // Пустой комментарий простаивающим подписчикам, чтобы найти оборванные соединения
+
+    // Таблица "расширение -> MIME-тип". Встроенные типы заполняются при первом обращении,
+    // дополнять таблицу (RegisterMimeType/LoadMimeTypes) нужно до запуска сервера
+    std::unordered_map<std::string, std::string> &MimeTypes()
+    {
+        static std::unordered_map<std::string, std::string> types = {
+            {"html", "text/html"},
+            {"htm", "text/html"},
+            {"css", "text/css"},
+            {"js", "text/javascript"},
+            {"mjs", "text/javascript"},
+            {"json", "application/json"},
+            {"txt", "text/plain"},
+            {"log", "text/plain"},
+            {"csv", "text/csv"},
+            {"xml", "application/xml"},
+            {"svg", "image/svg+xml"},
+            {"png", "image/png"},
+            {"jpg", "image/jpeg"},
+            {"jpeg", "image/jpeg"},
+            {"gif", "image/gif"},
+            {"ico", "image/x-icon"},
+            {"webp", "image/webp"},
+            {"woff", "font/woff"},
+            {"woff2", "font/woff2"},
+            {"ttf", "font/ttf"},
+            {"pdf", "application/pdf"},
+            {"wasm", "application/wasm"},
+            {"gz", "application/gzip"},
+            {"zip", "application/zip"},
+        };
+        return types;
+    }
+
+    // Добавляет или переопределяет тип для расширения (без точки)
+    void RegisterMimeType(const std::string &extension, const std::string &mime_type)
+    {
+        std::string ext = extension;
+        for (auto &ch : ext)
+        {
+            ch = (char)std::tolower((unsigned char)ch);
+        }
+        MimeTypes()[ext] = mime_type;
+    }
+
+    // Загружает типы из файла в формате mime.types: "тип расш1 расш2 ...", # - комментарий.
+    // Возвращает число добавленных расширений
+    size_t LoadMimeTypes(const std::string &file_path)
     {
-        std::string mimeType = "application/unknown";
-        std::string extension = filename.substr(filename.find_last_of('.'));
-        
-        #ifdef WIN32
-        // Получение типа контента из реестра Windows
-        HKEY hKey;
-        if (RegOpenKeyEx(HKEY_CLASSES_ROOT, extension.c_str(), 0, KEY_READ, &hKey) == ERROR_SUCCESS)
+        std::ifstream file(file_path);
+        if (!file)
+        {
+            return 0;
+        }
+
+        size_t count = 0;
+        std::string line;
+        while (std::getline(file, line))
         {
-            char buffer[256];
-            DWORD bufferSize = sizeof(buffer);
-            if (RegQueryValueEx(hKey, "Content Type", NULL, NULL, (LPBYTE)buffer, &bufferSize) == ERROR_SUCCESS)
+            line = line.substr(0, line.find('#'));
+            std::istringstream iss(line);
+            std::string mime_type, extension;
+            if (!(iss >> mime_type)) continue;
+            while (iss >> extension)
             {
-                mimeType = buffer;
+                RegisterMimeType(extension, mime_type);
+                ++count;
             }
-            RegCloseKey(hKey);
         }
-        #else
-        // Использование команды file для получения типа MIME в Linux
-        auto result = utillib::Exec(("file --mime-type -b " + filename).c_str());
-        if (result.find("cannot open") == std::string::npos && result.find("ERROR") == std::string::npos)
+        return count;
+    }
+
+    std::string GetMimeType(const std::string &filename)
+    {
+        size_t dot = filename.find_last_of('.');
+        if (dot == std::string::npos || filename.find('/', dot) != std::string::npos)
+        {
+            return DEFAULT_MIME_TYPE;
+        }
+
+        std::string extension = filename.substr(dot + 1);
+        for (auto &ch : extension)
         {
-            mimeType = utillib::Trim(result);
+            ch = (char)std::tolower((unsigned char)ch);
         }
-        #endif
 
-        return mimeType;
+        const auto &types = MimeTypes();
+        auto it = types.find(extension);
+        return it != types.end() ? it->second : DEFAULT_MIME_TYPE;
     }
 
-    std::string FindFile(const std::string &file_path)
+    // Путь файла по URL: адрес без расширения ведёт на temperature.html в этом каталоге
+    std::string NormalizeFilePath(const std::string &file_path)
     {
         std::string path = file_path;
         if (path.find(".") == std::string::npos)
         {
             path += path.ends_with("/") ? "temperature.html" : "/temperature.html";
         }
+        return path;
+    }
+
+    // Каталоги поиска статических файлов в порядке приоритета
+    std::vector<std::string> GetFileDirectories(const std::string &path)
+    {
+        if (path.ends_with(".js")) return {"../js", "./js", "..", "."};
+        return {"../html", "./html", "..", "."};
+    }
 
-        std::vector<std::string> directories = {"../html", "./html", "..", "."};
-        if (path.ends_with(".js")) directories = {"../js", "./js", "..", "."};
+    std::string FindFile(const std::string &file_path)
+    {
+        std::string path = NormalizeFilePath(file_path);
+        std::vector<std::string> directories = GetFileDirectories(path);
 
         for (const auto &dir : directories)
         {
@@ -86,83 +191,408 @@ namespace srvlib
         return "";
     }
 
-    class SpecialResponse;
+    // Имена заголовков HTTP не зависят от регистра, храним их в нижнем регистре
+    std::string HeaderKey(const std::string &key)
+    {
+        std::string lower = key;
+        for (auto &ch : lower)
+        {
+            ch = (char)std::tolower((unsigned char)ch);
+        }
+        return lower;
+    }
+
+    bool EqualsIgnoreCase(std::string_view a, std::string_view b)
+    {
+        if (a.size() != b.size()) return false;
+        for (size_t i = 0; i < a.size(); ++i)
+        {
+            if (std::tolower((unsigned char)a[i]) != std::tolower((unsigned char)b[i])) return false;
+        }
+        return true;
+    }
 
+    // Участок данных запроса: смещение от начала запроса и длина. Смещения, а не указатели,
+    // потому что буфер соединения может переехать при дописывании
+    struct Slice
+    {
+        uint32_t offset = 0;
+        uint32_t length = 0;
 
-    class Request
-{
-    std::string method;
-    std::string url;
-    std::string fileUrl;
-    std::string version;
-    std::unordered_map<std::string, std::string> headers;
-    std::unordered_map<std::string, std::string> urlArgs;
+        std::string_view In(std::string_view data) const { return data.substr(offset, length); }
+    };
 
-public:
-    Request(const std::string &data)
+    // Возобновляемый разбор запроса HTTP/1.x по буферу соединения, в который только дописывают.
+    // Каждый вызов Parse продолжает с места остановки, так что запрос, пришедший по частям,
+    // не просматривается заново. Разбор не выделяет память: метод, путь, аргументы и заголовки
+    // хранятся участками буфера. Нарушение синтаксиса или лимитов даёт строку статуса для ответа
+    class RequestParser
     {
-        std::istringstream recv(data);
-        std::string line;
-        std::getline(recv, line);
+    public:
+        enum Status
+        {
+            PARSE_INCOMPLETE, // Нужны ещё данные
+            PARSE_DONE,       // Запрос целиком в первых GetLength() байтах
+            PARSE_ERROR       // Ответить статусом GetError() и закрыть соединение
+        };
 
-        std::vector<std::string> split;
-        std::string word;
-        std::istringstream iss(line);
-        while (iss >> word) {
-            split.push_back(word);
-        }
+        struct Field
+        {
+            Slice name;
+            Slice value;
+        };
 
-        std::string urlPart = split[1];
-        size_t pos = urlPart.find('?');
-        if (pos != std::string::npos) {
-            url = urlPart.substr(0, pos);
-            std::string args = urlPart.substr(pos + 1);
-            size_t start = 0, end;
-            while ((end = args.find('&', start)) != std::string::npos) {
-                std::string arg = args.substr(start, end - start);
-                size_t equalPos = arg.find('=');
-                if (equalPos != std::string::npos) {
-                    urlArgs[arg.substr(0, equalPos)] = arg.substr(equalPos + 1);
+        // data - данные с начала запроса; между вызовами они могут только дописываться
+        Status Parse(std::string_view data)
+        {
+            while (m_state != STATE_DONE && m_state != STATE_ERROR)
+            {
+                if (m_state == STATE_BODY)
+                {
+                    if (data.size() < m_body.offset + m_body.length) return PARSE_INCOMPLETE;
+                    m_state = STATE_DONE;
+                    break;
+                }
+
+                bool request_line = m_state == STATE_REQUEST_LINE;
+                size_t limit = request_line ? MAX_REQUEST_LINE : MAX_HEADER_LINE;
+                size_t newline = data.find('\n', m_pos);
+                if (newline == std::string_view::npos)
+                {
+                    m_pos = data.size();
+                    if (data.size() - m_line_start > limit)
+                    {
+                        return Fail(request_line ? "414 URI Too Long" : "431 Request Header Fields Too Large", true);
+                    }
+                    return PARSE_INCOMPLETE;
+                }
+
+                size_t line_start = m_line_start;
+                size_t line_end = newline > line_start && data[newline - 1] == '\r' ? newline - 1 : newline;
+                m_line_start = m_pos = newline + 1;
+                if (line_end - line_start > limit)
+                {
+                    return Fail(request_line ? "414 URI Too Long" : "431 Request Header Fields Too Large", true);
+                }
+                if (m_line_start > MAX_REQUEST_SIZE)
+                {
+                    return Fail("431 Request Header Fields Too Large", true);
                 }
-                start = end + 1;
-            }
 
-            std::string arg = args.substr(start);
-            size_t equalPos = arg.find('=');
-            if (equalPos != std::string::npos) {
-                urlArgs[arg.substr(0, equalPos)] = arg.substr(equalPos + 1);
+                std::string_view line = data.substr(line_start, line_end - line_start);
+                if (request_line)
+                {
+                    if (!line.empty()) ParseRequestLine(line, line_start); // Пустые строки перед запросом допустимы
+                }
+                else if (line.empty())
+                {
+                    EndHeaders();
+                }
+                else
+                {
+                    ParseHeader(line, line_start);
+                }
             }
-        } else {
-            url = urlPart;
+            return m_state == STATE_DONE ? PARSE_DONE : PARSE_ERROR;
         }
 
-        method = split[0];
-        version = split[2];
+        // Готов к следующему запросу
+        void Reset() { *this = RequestParser(); }
 
+        // Длина разобранного запроса вместе с телом
+        size_t GetLength() const { return m_body.offset + m_body.length; }
 
-        fileUrl = FindFile(url);
+        // Строка статуса ответа на ошибку ("400 Bad Request")
+        const char *GetError() const { return m_error; }
 
+        // Ошибка из-за превышения лимитов размера
+        bool IsTooLarge() const { return m_too_large; }
 
-        while (std::getline(recv, line)) {
-            if (line == "\r" || line == "\n") {
-                break;
+        Slice GetMethod() const { return m_method; }
+        Slice GetPath() const { return m_path; }
+        Slice GetVersion() const { return m_version; }
+        Slice GetBody() const { return m_body; }
+        const Field *GetHeaders() const { return m_headers; }
+        size_t GetHeaderCount() const { return m_header_count; }
+        const Field *GetArgs() const { return m_args; }
+        size_t GetArgCount() const { return m_arg_count; }
+
+    private:
+        enum State
+        {
+            STATE_REQUEST_LINE,
+            STATE_HEADERS,
+            STATE_BODY,
+            STATE_DONE,
+            STATE_ERROR
+        };
+
+        Status Fail(const char *error, bool too_large = false)
+        {
+            m_state = STATE_ERROR;
+            m_error = error;
+            m_too_large = too_large;
+            return PARSE_ERROR;
+        }
+
+        static Slice MakeSlice(size_t offset, size_t length) { return {(uint32_t)offset, (uint32_t)length}; }
+
+        // Метод SP адрес SP версия; адрес - путь от '/' и необязательные аргументы после '?'
+        void ParseRequestLine(std::string_view line, size_t base)
+        {
+            size_t first = line.find(' ');
+            size_t second = first == std::string_view::npos ? first : line.find(' ', first + 1);
+            if (second == std::string_view::npos || line.find(' ', second + 1) != std::string_view::npos)
+            {
+                Fail("400 Bad Request");
+                return;
+            }
+
+            std::string_view method = line.substr(0, first);
+            std::string_view target = line.substr(first + 1, second - first - 1);
+            std::string_view version = line.substr(second + 1);
+            if (method.empty() || !std::all_of(method.begin(), method.end(), [](char ch) { return ch >= 'A' && ch <= 'Z'; }) ||
+                !target.starts_with('/') ||
+                std::any_of(target.begin(), target.end(), [](char ch) { return (unsigned char)ch <= ' ' || ch == 127; }))
+            {
+                Fail("400 Bad Request");
+                return;
+            }
+            if (version != "HTTP/1.1" && version != "HTTP/1.0")
+            {
+                Fail(version.starts_with("HTTP/") ? "505 HTTP Version Not Supported" : "400 Bad Request");
+                return;
+            }
+
+            size_t target_start = base + first + 1;
+            size_t query = target.find('?');
+            m_method = MakeSlice(base, method.size());
+            m_path = MakeSlice(target_start, std::min(query, target.size()));
+            m_version = MakeSlice(base + second + 1, version.size());
+            m_state = STATE_HEADERS;
+
+            // Аргументы key=value через '&'; аргументы без '=' пропускаются
+            size_t pos = query;
+            while (pos < target.size())
+            {
+                size_t start = pos + 1;
+                size_t end = std::min(target.find('&', start), target.size());
+                size_t equal = target.find('=', start);
+                if (equal < end)
+                {
+                    if (m_arg_count == MAX_URL_ARGS)
+                    {
+                        Fail("414 URI Too Long", true);
+                        return;
+                    }
+                    m_args[m_arg_count++] = {MakeSlice(target_start + start, equal - start),
+                                             MakeSlice(target_start + equal + 1, end - equal - 1)};
+                }
+                pos = end;
+            }
+        }
+
+        // Имя: значение; пробелы вокруг значения отбрасываются, перенос заголовка на новую строку запрещён
+        void ParseHeader(std::string_view line, size_t base)
+        {
+            size_t colon = line.find(':');
+            std::string_view name = line.substr(0, std::min(colon, line.size()));
+            if (colon == std::string_view::npos || name.empty() ||
+                std::any_of(name.begin(), name.end(), [](char ch) { return (unsigned char)ch <= ' ' || ch == 127; }))
+            {
+                Fail("400 Bad Request");
+                return;
+            }
+            if (m_header_count == MAX_HEADERS)
+            {
+                Fail("431 Request Header Fields Too Large", true);
+                return;
+            }
+
+            size_t start = colon + 1;
+            size_t end = line.size();
+            while (start < end && (line[start] == ' ' || line[start] == '\t')) ++start;
+            while (end > start && (line[end - 1] == ' ' || line[end - 1] == '\t')) --end;
+            std::string_view value = line.substr(start, end - start);
+            m_headers[m_header_count++] = {MakeSlice(base, name.size()), MakeSlice(base + start, value.size())};
+
+            if (EqualsIgnoreCase(name, "Content-Length"))
+            {
+                size_t length = 0;
+                if (value.empty() || value.size() > 9 || !std::all_of(value.begin(), value.end(), [](char ch) { return ch >= '0' && ch <= '9'; }))
+                {
+                    Fail("400 Bad Request");
+                    return;
+                }
+                for (char ch : value) length = length * 10 + (ch - '0');
+                if (m_has_length && length != m_content_length)
+                {
+                    Fail("400 Bad Request"); // Разные длины - признак подмены запроса
+                    return;
+                }
+                m_has_length = true;
+                m_content_length = length;
+            }
+            else if (EqualsIgnoreCase(name, "Transfer-Encoding"))
+            {
+                Fail("501 Not Implemented"); // Тела по частям (chunked) не поддерживаются
+            }
+        }
+
+        void EndHeaders()
+        {
+            if (m_line_start + m_content_length > MAX_REQUEST_SIZE)
+            {
+                Fail("413 Payload Too Large", true);
+                return;
             }
-            size_t colonPos = line.find(": ");
-            if (colonPos != std::string::npos) {
-                std::string key = line.substr(0, colonPos);
-                std::string value = line.substr(colonPos + 2);
-                headers[key] = value;
+            m_body = MakeSlice(m_line_start, m_content_length);
+            m_state = STATE_BODY;
+        }
+
+        State m_state = STATE_REQUEST_LINE;
+        size_t m_pos = 0; // Откуда продолжить поиск конца строки
+        size_t m_line_start = 0;
+        const char *m_error = "";
+        bool m_too_large = false;
+        bool m_has_length = false;
+        size_t m_content_length = 0;
+        Slice m_method;
+        Slice m_path;
+        Slice m_version;
+        Slice m_body;
+        Field m_headers[MAX_HEADERS];
+        size_t m_header_count = 0;
+        Field m_args[MAX_URL_ARGS];
+        size_t m_arg_count = 0;
+    };
+
+    class EventStream;
+
+    // Разобранный запрос. Метод, путь, заголовки и аргументы - участки данных запроса без копирования
+    class Request
+{
+    std::string owned; // Данные запроса, если он создан из строки
+    std::string_view data;
+    RequestParser parsed;
+    bool valid = false;
+    mutable std::string fileUrl; // Вычисляется при первом обращении
+    mutable bool fileUrlResolved = false;
+    std::vector<std::pair<std::string, std::string>> params; // Параметры шаблона маршрута
+
+    std::string_view Find(const RequestParser::Field *fields, size_t count, std::string_view key, bool ignore_case, bool &found) const
+    {
+        // Повторы: как и раньше, действует последний
+        for (size_t i = count; i-- > 0;)
+        {
+            std::string_view name = fields[i].name.In(data);
+            if (ignore_case ? EqualsIgnoreCase(name, key) : name == key)
+            {
+                found = true;
+                return fields[i].value.In(data);
             }
         }
+        found = false;
+        return {};
+    }
+
+public:
+    // Запрос над уже разобранными данными (буфер соединения); data должны жить дольше запроса
+    Request(std::string_view request_data, const RequestParser &parser)
+        : data(request_data), parsed(parser), valid(true)
+    {
+    }
+
+    // Разбирает запрос из строки целиком; неполный или неверный запрос - IsValid() == false
+    Request(const std::string &request_data) : owned(request_data), data(owned)
+    {
+        valid = parsed.Parse(data) == RequestParser::PARSE_DONE;
+        if (!valid) parsed.Reset();
+    }
+
+    Request(const Request &) = delete;
+    Request &operator=(const Request &) = delete;
+
+    bool IsValid() const { return valid; }
+
+    std::string_view GetMethod() const { return parsed.GetMethod().In(data); }
+    std::string_view GetURL() const { return parsed.GetPath().In(data); }
+    std::string GetFileURL() const
+    {
+        if (!fileUrlResolved)
+        {
+            fileUrl = FindFile(std::string(GetURL()));
+            fileUrlResolved = true;
+        }
+        return fileUrl;
+    }
+    std::string_view GetVersion() const { return parsed.GetVersion().In(data); }
+    std::string_view GetBody() const { return parsed.GetBody().In(data); }
+
+    // Значение заголовка; std::out_of_range, если заголовка нет
+    std::string GetHeader(const std::string &key) const
+    {
+        bool found = false;
+        std::string_view value = Find(parsed.GetHeaders(), parsed.GetHeaderCount(), key, true, found);
+        if (!found) throw std::out_of_range("No header: " + key);
+        return std::string(value);
+    }
+
+    // Значение заголовка или def, если заголовка нет
+    std::string GetHeader(const std::string &key, const std::string &def) const
+    {
+        bool found = false;
+        std::string_view value = Find(parsed.GetHeaders(), parsed.GetHeaderCount(), key, true, found);
+        return found ? std::string(value) : def;
+    }
+
+    bool HasHeader(const std::string &key) const
+    {
+        bool found = false;
+        Find(parsed.GetHeaders(), parsed.GetHeaderCount(), key, true, found);
+        return found;
+    }
+
+    // Кодирование ответа, которое примет клиент (по Accept-Encoding)
+    ContentEncoding GetAcceptedEncoding() const { return SelectEncoding(GetHeader("Accept-Encoding", "")); }
+
+    // Аргумент строки запроса (?key=value) или def, если его нет
+    std::string GetArg(const std::string &key, const std::string &def = "") const
+    {
+        bool found = false;
+        std::string_view value = Find(parsed.GetArgs(), parsed.GetArgCount(), key, false, found);
+        return found ? std::string(value) : def;
+    }
+
+    bool HasArg(const std::string &key) const
+    {
+        bool found = false;
+        Find(parsed.GetArgs(), parsed.GetArgCount(), key, false, found);
+        return found;
+    }
+
+    // Параметр шаблона маршрута (":id" в "/sensors/:id", "*" для остатка пути префиксного маршрута) или def
+    std::string GetParam(const std::string &key, const std::string &def = "") const
+    {
+        for (const auto &param : params)
+        {
+            if (param.first == key) return param.second;
+        }
+        return def;
     }
 
-    bool CheckResponse(SpecialResponse response) const;
+    void SetParams(std::vector<std::pair<std::string, std::string>> values) { params = std::move(values); }
 
-    std::string GetMethod() const { return method; }
-    std::string GetURL() const { return url; }
-    std::string GetFileURL() const { return fileUrl; }
-    std::string GetVersion() const { return version; }
-    std::string GetHeader(const std::string &key) const { return headers.at(key); }
+    // Хочет ли клиент сохранить соединение: в HTTP/1.1 по умолчанию да, в HTTP/1.0 только по keep-alive
+    bool IsKeepAlive() const
+    {
+        std::string connection = HeaderKey(GetHeader("Connection", ""));
+        if (GetVersion() == "HTTP/1.1")
+        {
+            return connection.find("close") == std::string::npos;
+        }
+        return connection.find("keep-alive") != std::string::npos;
+    }
 };
 
     class Response
@@ -171,6 +601,8 @@ protected:
     std::string responseType;
     std::string contentType;
     std::string version;
+    std::string connection; // Заголовки управления соединением
+    std::string encodingHeaders; // Content-Encoding и Vary
 
 public:
     // Конструктор с тремя параметрами
@@ -199,7 +631,7 @@ public:
     // Конструктор на основе запроса
     Response(const Request &request) : Response("200 OK") // Вызываем конструктор по умолчанию
     {
-        version = request.GetVersion();
+        version = std::string(request.GetVersion());
         contentType = GetMimeType(request.GetFileURL()); // Устанавливаем тип контента
     }
 
@@ -221,59 +653,296 @@ public:
         contentType = content;
     }
 
+    std::string GetContentType() const { return contentType; }
+
+    // Кодирование тела; vary - представление зависит от Accept-Encoding (заголовок Vary для кэшей)
+    void SetEncoding(ContentEncoding encoding, bool vary = true)
+    {
+        encodingHeaders.clear();
+        if (encoding != ENCODING_IDENTITY)
+        {
+            encodingHeaders.append("Content-Encoding: ").append(GetEncodingName(encoding)).append("\r\n");
+        }
+        if (vary)
+        {
+            encodingHeaders.append("Vary: Accept-Encoding\r\n");
+        }
+    }
+
+    // Установка заголовков Connection/Keep-Alive
+    void SetKeepAlive(bool keep_alive, int timeout_sec = KEEP_ALIVE_TIMEOUT_SEC, int max_requests = KEEP_ALIVE_MAX_REQUESTS)
+    {
+        if (keep_alive)
+        {
+            connection = "Connection: keep-alive\r\nKeep-Alive: timeout=" + std::to_string(timeout_sec) +
+                         ", max=" + std::to_string(max_requests) + "\r\n";
+        }
+        else
+        {
+            connection = "Connection: close\r\n";
+        }
+    }
+
+    // Заголовки ответа с телом длины content_length, включая пустую строку-разделитель
+    std::string GetHead(size_t content_length) const
+    {
+        std::string head;
+        head.reserve(128 + connection.size() + encodingHeaders.size());
+        head.append(version).append(" ").append(responseType).append("\r\n")
+            .append("Content-Type: ").append(contentType).append("\r\n")
+            .append("Content-Length: ").append(std::to_string(content_length)).append("\r\n")
+            .append(encodingHeaders)
+            .append(connection).append("\r\n");
+        return head;
+    }
+
     // Формирование ответа
     std::string GetAnswer(const std::string &body) const
     {
-        std::stringstream answer; // Создаем строковый поток
-        answer << version << " " << responseType << "\r\n"
-               << "Content-Type: " << contentType << "\r\n"
-               << "Content-Length: " << body.length() << "\r\n\r\n"
-               << body; // Добавляем тело ответа
-        return answer.str(); // Возвращаем строку
+        std::string answer = GetHead(body.length());
+        answer.append(body);
+        return answer;
     }
 };
 
-    class SpecialResponse : public Response
+    // Ответ, готовый к отправке: заголовки (или весь ответ), тело в памяти и файлы тела.
+    // Заголовки и тело уходят одним writev, файлы - через sendfile
+    struct Reply
+    {
+        std::shared_ptr<const std::string> head;
+        std::shared_ptr<const std::string> body;
+        std::vector<std::string> files;
+        std::vector<size_t> file_sizes; // Сколько байт каждого файла отправить
+        size_t files_size = 0; // Суммарный размер файлов, заявленный в Content-Length
+        bool last_open = false; // Последний файл ещё дописывается (открытый сегмент лога)
+        size_t route = 0; // Маршрут ответа для метрик
+        EventStream *stream = nullptr; // Соединение переходит в подписчики этого потока событий
+    };
+
+    // Фиксирует размеры файлов ответа и возвращает их сумму; отсутствующие файлы пропускаются.
+    // Дописанные после этого данные не отправляются, так что Content-Length остаётся верным
+    size_t GetFilesSize(Reply &reply)
+    {
+        reply.file_sizes.clear();
+        reply.files_size = 0;
+        for (auto it = reply.files.begin(); it != reply.files.end();)
+        {
+            std::error_code ec;
+            auto size = fs::file_size(*it, ec);
+            if (ec)
+            {
+                if (std::next(it) == reply.files.end()) reply.last_open = false;
+                it = reply.files.erase(it);
+                continue;
+            }
+            reply.file_sizes.push_back(size);
+            reply.files_size += size;
+            ++it;
+        }
+        return reply.files_size;
+    }
+
+    // Полный размер ответа в байтах
+    size_t GetReplySize(const Reply &reply)
     {
-    protected:
-        std::string method;
-        std::string url;
-        std::string (*bodyFunc)(void);
-        bool isRaw;
+        return (reply.head ? reply.head->length() : 0) + (reply.body ? reply.body->length() : 0) + reply.files_size;
+    }
+
+    // Что обработчик маршрута отправляет в ответ
+    enum BodyType
+    {
+        BODY_TEXT,  // Тело, собранное Write
+        BODY_FILES, // Содержимое файлов (sendfile без копирования)
+        BODY_PARTS, // Части, неизменные из которых сжимаются один раз
+        BODY_RAW,   // Готовый ответ целиком, с заголовками; соединение после него закрывается
+        BODY_STREAM // Соединение переходит в подписчики потока событий
+    };
 
+    // Ответ обработчика маршрута: код и тип (методы Response) и тело одного из видов BodyType.
+    // По умолчанию "200 OK", text/plain и пустое тело
+    class ResponseWriter : public Response
+    {
     public:
-        SpecialResponse(const std::string &meth, const std::string &url, std::string (*func)(void), bool raw = false)
-            : Response()
+        // Дописывает данные в тело
+        void Write(const std::string &data)
         {
-            method = meth;
-            this->url = url;
-            bodyFunc = func;
-            isRaw = raw;
+            m_type = BODY_TEXT;
+            m_body.append(data);
         }
 
-        std::string GetBody()
+        // last_open - последний файл ещё дописывается: его сжатие не кэшируется
+        void SendFiles(std::vector<std::string> files, bool last_open = false)
         {
-            if (bodyFunc == NULL)
-            {
-                return "";
-            }
-            return bodyFunc(); // Получаем тело
+            m_type = BODY_FILES;
+            m_files = std::move(files);
+            m_last_open = last_open;
+        }
+
+        void SendParts(std::vector<BodyPart> parts)
+        {
+            m_type = BODY_PARTS;
+            m_parts = std::move(parts);
+        }
+
+        void SendRaw(const std::string &answer)
+        {
+            m_type = BODY_RAW;
+            m_body = answer;
         }
 
-        std::string GetAnswer()
+        // Поток должен быть зарегистрирован на сервере (HTTPServer::RegisterStream)
+        void Stream(EventStream &stream)
         {
-            return Response::GetAnswer(GetBody());
+            m_type = BODY_STREAM;
+            m_stream = &stream;
         }
 
-        std::string GetMethod() { return method; }
-        std::string GetURL() { return url; }
-        bool IsRaw() { return isRaw; }
+        BodyType GetBodyType() const { return m_type; }
+        std::string &GetBody() { return m_body; }
+        std::vector<std::string> &GetFiles() { return m_files; }
+        bool IsLastFileOpen() const { return m_last_open; }
+        const std::vector<BodyPart> &GetParts() const { return m_parts; }
+        EventStream *GetStream() const { return m_stream; }
+
+    private:
+        BodyType m_type = BODY_TEXT;
+        std::string m_body;
+        std::vector<std::string> m_files;
+        bool m_last_open = false;
+        std::vector<BodyPart> m_parts;
+        EventStream *m_stream = nullptr;
     };
 
-    bool Request::CheckResponse(SpecialResponse response) const
+    // Обработчик маршрута: видит разобранный запрос (аргументы, заголовки, параметры шаблона)
+    using Handler = std::function<void(const Request &, ResponseWriter &)>;
+
+    // Таблица маршрутов. Точные пути ищутся по заранее посчитанному хэшу метода и пути, затем по порядку
+    // регистрации проверяются шаблоны с параметрами ("/sensors/:id/series"), затем префиксы ("/files/*")
+    // от длинного к короткому. Поиск не выделяет память, пока не найден маршрут с параметрами
+    class Router
     {
-        return response.GetMethod() == GetMethod() && response.GetURL() == GetURL();
-    }
+    public:
+        // Добавляет маршрут и возвращает его номер
+        size_t Add(const std::string &method, const std::string &pattern, Handler handler)
+        {
+            size_t index = m_routes.size();
+            m_routes.push_back({method, pattern, std::move(handler), "", {}});
+            Route &route = m_routes.back();
+            if (pattern.ends_with("/*"))
+            {
+                route.prefix = pattern.substr(0, pattern.size() - 1);
+                m_prefix.push_back(index);
+                std::stable_sort(m_prefix.begin(), m_prefix.end(), [this](size_t a, size_t b)
+                                 { return m_routes[a].prefix.size() > m_routes[b].prefix.size(); });
+            }
+            else if (pattern.find("/:") != std::string::npos)
+            {
+                size_t start = 1;
+                while (start <= pattern.size())
+                {
+                    size_t end = std::min(pattern.find('/', start), pattern.size());
+                    route.segments.push_back(pattern.substr(start, end - start));
+                    start = end + 1;
+                }
+                m_param.push_back(index);
+            }
+            else
+            {
+                m_exact[Hash(method, pattern)].push_back(index);
+            }
+            return index;
+        }
+
+        // Номер маршрута для запроса или -1; параметры шаблона сохраняются в request
+        int Match(Request &request) const
+        {
+            std::string_view method = request.GetMethod();
+            std::string_view path = request.GetURL();
+
+            auto it = m_exact.find(Hash(method, path));
+            if (it != m_exact.end())
+            {
+                for (size_t index : it->second)
+                {
+                    if (m_routes[index].method == method && m_routes[index].pattern == path) return (int)index;
+                }
+            }
+
+            for (size_t index : m_param)
+            {
+                const Route &route = m_routes[index];
+                if (route.method == method && MatchSegments(route.segments, path, nullptr))
+                {
+                    std::vector<std::pair<std::string, std::string>> params;
+                    MatchSegments(route.segments, path, &params);
+                    request.SetParams(std::move(params));
+                    return (int)index;
+                }
+            }
+
+            for (size_t index : m_prefix)
+            {
+                const Route &route = m_routes[index];
+                if (route.method == method && path.starts_with(route.prefix))
+                {
+                    request.SetParams({{"*", std::string(path.substr(route.prefix.size()))}});
+                    return (int)index;
+                }
+            }
+            return -1;
+        }
+
+        size_t Size() const { return m_routes.size(); }
+        const Handler &GetHandler(size_t index) const { return m_routes[index].handler; }
+        const std::string &GetMethod(size_t index) const { return m_routes[index].method; }
+        const std::string &GetPattern(size_t index) const { return m_routes[index].pattern; }
+
+    private:
+        struct Route
+        {
+            std::string method;
+            std::string pattern;
+            Handler handler;
+            std::string prefix; // Для префиксных маршрутов: шаблон без '*'
+            std::vector<std::string> segments; // Для маршрутов с параметрами: сегменты шаблона
+        };
+
+        static size_t Hash(std::string_view method, std::string_view path)
+        {
+            std::hash<std::string_view> hash;
+            return hash(method) * 31 + hash(path);
+        }
+
+        // Совпадает ли путь с сегментами шаблона; при params сохраняет значения параметров
+        static bool MatchSegments(const std::vector<std::string> &segments, std::string_view path,
+                                  std::vector<std::pair<std::string, std::string>> *params)
+        {
+            if (!path.starts_with('/')) return false;
+            size_t pos = 1;
+            for (const auto &segment : segments)
+            {
+                if (pos > path.size()) return false;
+                size_t end = std::min(path.find('/', pos), path.size());
+                std::string_view part = path.substr(pos, end - pos);
+                if (segment.starts_with(':'))
+                {
+                    if (part.empty()) return false;
+                    if (params) params->emplace_back(segment.substr(1), std::string(part));
+                }
+                else if (part != segment)
+                {
+                    return false;
+                }
+                pos = end + 1;
+            }
+            return pos == path.size() + 1;
+        }
+
+        std::vector<Route> m_routes;
+        std::unordered_map<size_t, std::vector<size_t>> m_exact; // Хэш метода и пути -> маршруты
+        std::vector<size_t> m_param; // Маршруты с параметрами по порядку регистрации
+        std::vector<size_t> m_prefix; // Префиксные маршруты, длинные первыми
+    };
 
     class ErrorResponse : public Response
     {
@@ -284,33 +953,452 @@ public:
         {
             return Response::GetAnswer("<html><body>404 Not Found</body></html>");
         }
+
+        using Response::GetAnswer;
     };
 
-    class SocketBase
-{
-public:
-    // Конструктор, инициализирующий сокет
-    SocketBase() : m_socket(INVALID_SOCKET)
+    // Кэш статических файлов html/ и js/ с готовыми ответами (заголовки + тело) по URL.
+    // Текстовые файлы сжимаются gzip и deflate один раз при загрузке. Записи обновляются по событиям inotify (Linux):
+    // перечитываются только изменённые файлы. Без inotify изменённый файл отдаётся мимо кэша (по времени изменения)
+    class StaticCache
     {
-#ifdef WIN32
-        WSADATA wsaData;
-        WSAStartup(MAKEWORD(2, 2), &wsaData);
-#else
-        signal(SIGPIPE, SIG_IGN);
-#endif
-    }
+    public:
+        StaticCache() = default;
 
-    // Деструктор, закрывающий сокет
-    ~SocketBase()
-    {
-        CloseSocket();
-#if defined(WIN32)
-        WSACleanup();
+        ~StaticCache()
+        {
+#ifndef WIN32
+            if (m_notify_fd >= 0) close(m_notify_fd);
 #endif
-    }
+        }
 
-    // Получаем код последней ошибки
-    static int GetErrorCode()
+        StaticCache(const StaticCache &) = delete;
+        StaticCache &operator=(const StaticCache &) = delete;
+
+        // Загружает все файлы из каталогов поиска html/ и js/
+        void Load(int keep_alive_timeout, int keep_alive_max)
+        {
+            std::lock_guard<std::mutex> reload_lock(m_reload_mutex);
+            m_keep_alive_timeout = keep_alive_timeout;
+            m_keep_alive_max = keep_alive_max;
+#ifndef WIN32
+            if (m_notify_fd < 0)
+            {
+                m_notify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+            }
+#endif
+            Reload();
+        }
+
+        bool IsLoaded() const
+        {
+            std::shared_lock<std::shared_mutex> lock(m_mutex);
+            return m_loaded;
+        }
+
+        // Готовый ответ на URL в кодировании encoding (если сжатой версии нет - без сжатия)
+        // или nullptr, если файла нет в кэше
+        std::shared_ptr<const std::string> Find(const std::string &url, bool keep_alive, ContentEncoding encoding = ENCODING_IDENTITY) const
+        {
+            std::string path = NormalizeFilePath(url);
+            std::shared_lock<std::shared_mutex> lock(m_mutex);
+            const auto &entries = path.ends_with(".js") ? m_js : m_html;
+            auto it = entries.find(path);
+            if (it == entries.end())
+            {
+                return nullptr;
+            }
+            if (m_notify_fd < 0)
+            {
+                std::error_code ec;
+                if (fs::last_write_time(it->second.file_path, ec) != it->second.mtime)
+                {
+                    return nullptr; // Файл изменился, ответ будет собран заново
+                }
+            }
+            return it->second.answers[encoding][keep_alive ? 1 : 0];
+        }
+
+        // Дескриптор inotify для ожидания в цикле событий, -1 если недоступен
+        int GetNotifyFd() const { return m_notify_fd; }
+
+        // Событие inotify: wd каталога, маска и имя файла в нём
+        struct FileEvent
+        {
+            int wd;
+            uint32_t mask;
+            std::string name;
+        };
+
+        // Вычитывает события inotify без чтения самих файлов: выполняется в потоке epoll.
+        // Перечитывать файлы - ApplyEvents в рабочем потоке
+        std::vector<FileEvent> ReadEvents()
+        {
+            std::vector<FileEvent> events;
+#ifndef WIN32
+            alignas(struct inotify_event) char buf[4096];
+            ssize_t length;
+            while ((length = read(m_notify_fd, buf, sizeof(buf))) > 0)
+            {
+                for (ssize_t offset = 0; offset < length;)
+                {
+                    const struct inotify_event *event = (const struct inotify_event *)(buf + offset);
+                    events.push_back({event->wd, event->mask, event->len > 0 ? std::string(event->name) : std::string()});
+                    offset += sizeof(struct inotify_event) + event->len;
+                }
+            }
+#endif
+            return events;
+        }
+
+        // Обновляет записи изменённых файлов. Если изменились сами каталоги или очередь событий переполнилась -
+        // перечитывает всё. Ответы на запросы тем временем отдаются из прежних записей
+        void ApplyEvents(const std::vector<FileEvent> &events)
+        {
+#ifndef WIN32
+            std::lock_guard<std::mutex> reload_lock(m_reload_mutex);
+            bool full_reload = false;
+            std::vector<std::pair<WatchedDir, std::string>> files; // Каталог и путь изменённого файла
+            for (const auto &event : events)
+            {
+                if (event.mask & IN_Q_OVERFLOW)
+                {
+                    full_reload = true;
+                    continue;
+                }
+                auto it = m_watches.find(event.wd);
+                if (it == m_watches.end()) continue;
+                if (event.mask & IN_IGNORED)
+                {
+                    m_watches.erase(it); // Каталог удалён, наблюдение снято
+                    continue;
+                }
+                if ((event.mask & (IN_ISDIR | IN_DELETE_SELF)) || event.name.empty())
+                {
+                    full_reload = true;
+                    continue;
+                }
+                files.push_back({it->second, it->second.path + "/" + event.name});
+            }
+
+            if (full_reload)
+            {
+                Reload();
+                return;
+            }
+            for (const auto &[dir, file_path] : files)
+            {
+                UpdateFile(dir, file_path);
+            }
+#else
+            (void)events;
+#endif
+        }
+
+    private:
+        struct Entry
+        {
+            std::string file_path;
+            fs::file_time_type mtime;
+            std::shared_ptr<const std::string> answers[3][2]; // По ContentEncoding и keep-alive
+        };
+
+        // Наблюдаемый каталог: корень поиска, от которого отсчитываются URL его файлов
+        struct WatchedDir
+        {
+            std::string path;
+            std::string root;
+            bool js = false;
+        };
+
+        // Перечитывает все файлы и обновляет наблюдение за каталогами. Вызывается под m_reload_mutex
+        void Reload()
+        {
+            std::unordered_map<std::string, Entry> html_entries = LoadDirectories(GetFileDirectories("/"), "");
+            std::unordered_map<std::string, Entry> js_entries = LoadDirectories(GetFileDirectories(".js"), ".js");
+
+            std::unique_lock<std::shared_mutex> lock(m_mutex);
+            m_html.swap(html_entries);
+            m_js.swap(js_entries);
+            m_loaded = true;
+        }
+
+        // Перечитывает один файл. Файл с тем же URL из каталога старшего приоритета перекрывает младшие,
+        // поэтому запись берётся из первого каталога поиска, где файл есть. Вызывается под m_reload_mutex
+        void UpdateFile(const WatchedDir &dir, const std::string &file_path)
+        {
+            std::string url = file_path.substr(dir.root.length());
+            if (dir.js && !url.ends_with(".js")) return;
+
+            std::optional<Entry> entry;
+            for (const auto &root : GetFileDirectories(dir.js ? ".js" : "/"))
+            {
+                std::error_code ec;
+                std::string candidate = root + url;
+                if (root == "." || root == ".." || !fs::is_regular_file(candidate, ec) ||
+                    fs::file_size(candidate, ec) > STATIC_CACHE_MAX_FILE_SIZE)
+                {
+                    continue;
+                }
+                try
+                {
+                    entry = MakeEntry(candidate);
+                }
+                catch (const std::exception &e)
+                {
+                    std::cerr << "Static cache error: " << e.what() << std::endl;
+                }
+                break;
+            }
+
+            std::unique_lock<std::shared_mutex> lock(m_mutex);
+            auto &entries = dir.js ? m_js : m_html;
+            if (entry)
+            {
+                entries[url] = std::move(*entry);
+            }
+            else
+            {
+                entries.erase(url);
+            }
+        }
+
+        // Каталоги обходятся от младшего приоритета к старшему, чтобы старшие перекрывали младшие.
+        // Корневые каталоги (".", "..") не кэшируются: из них отдаются только явно найденные файлы
+        std::unordered_map<std::string, Entry> LoadDirectories(const std::vector<std::string> &directories, const std::string &extension)
+        {
+            std::unordered_map<std::string, Entry> entries;
+            for (auto dir = directories.rbegin(); dir != directories.rend(); ++dir)
+            {
+                std::error_code ec;
+                if (*dir == "." || *dir == ".." || !fs::is_directory(*dir, ec)) continue;
+
+                bool js = !extension.empty();
+                Watch({*dir, *dir, js});
+                for (auto it = fs::recursive_directory_iterator(*dir, ec); !ec && it != fs::recursive_directory_iterator(); it.increment(ec))
+                {
+                    if (it->is_directory(ec))
+                    {
+                        Watch({it->path().generic_string(), *dir, js});
+                        continue;
+                    }
+                    if (!it->is_regular_file(ec) || it->file_size(ec) > STATIC_CACHE_MAX_FILE_SIZE) continue;
+
+                    std::string file_path = it->path().generic_string();
+                    if (!extension.empty() && !file_path.ends_with(extension)) continue;
+
+                    std::string url = file_path.substr(dir->length());
+                    try
+                    {
+                        entries[url] = MakeEntry(file_path);
+                    }
+                    catch (const std::exception &e)
+                    {
+                        std::cerr << "Static cache error: " << e.what() << std::endl;
+                    }
+                }
+            }
+            return entries;
+        }
+
+        Entry MakeEntry(const std::string &file_path) const
+        {
+            Entry entry;
+            entry.file_path = file_path;
+            entry.mtime = fs::last_write_time(file_path);
+
+            std::string bodies[3];
+            bodies[ENCODING_IDENTITY] = utillib::ReadFile(file_path);
+            Response response("200 OK", GetMimeType(file_path));
+            bool compressible = IsCompressibleType(response.GetContentType()) && bodies[ENCODING_IDENTITY].size() >= COMPRESS_MIN_SIZE;
+
+            for (int encoding = ENCODING_IDENTITY; encoding <= ENCODING_DEFLATE; ++encoding)
+            {
+                const std::string &identity = bodies[ENCODING_IDENTITY];
+                if (encoding != ENCODING_IDENTITY &&
+                    (!compressible || !EncodeBody(identity, (ContentEncoding)encoding, COMPRESS_LEVEL_CACHED, bodies[encoding]) ||
+                     bodies[encoding].size() >= identity.size()))
+                {
+                    entry.answers[encoding][0] = entry.answers[ENCODING_IDENTITY][0];
+                    entry.answers[encoding][1] = entry.answers[ENCODING_IDENTITY][1];
+                    continue;
+                }
+                response.SetEncoding((ContentEncoding)encoding, compressible);
+                response.SetKeepAlive(true, m_keep_alive_timeout, m_keep_alive_max);
+                entry.answers[encoding][1] = std::make_shared<const std::string>(response.GetAnswer(bodies[encoding]));
+                response.SetKeepAlive(false);
+                entry.answers[encoding][0] = std::make_shared<const std::string>(response.GetAnswer(bodies[encoding]));
+            }
+            return entry;
+        }
+
+        // Добавляет каталог под наблюдение inotify
+        void Watch(const WatchedDir &dir)
+        {
+#ifndef WIN32
+            if (m_notify_fd < 0) return;
+            int wd = inotify_add_watch(m_notify_fd, dir.path.c_str(), IN_CLOSE_WRITE | IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO | IN_DELETE_SELF);
+            if (wd >= 0) m_watches[wd] = dir;
+#else
+            (void)dir;
+#endif
+        }
+
+        std::mutex m_reload_mutex; // Одна перезагрузка за раз; файл перечитывается в текущем состоянии, так что порядок не важен
+        std::unordered_map<int, WatchedDir> m_watches; // wd -> каталог; под m_reload_mutex
+        mutable std::shared_mutex m_mutex; // Защищает записи кэша
+        std::unordered_map<std::string, Entry> m_html; // URL -> запись для html/
+        std::unordered_map<std::string, Entry> m_js; // URL -> запись для js/
+        bool m_loaded = false;
+        int m_notify_fd = -1;
+        int m_keep_alive_timeout = KEEP_ALIVE_TIMEOUT_SEC;
+        int m_keep_alive_max = KEEP_ALIVE_MAX_REQUESTS;
+    };
+
+    // Политика для подписчика, отставшего от потока событий больше чем на размер кольца
+    enum StreamPolicy
+    {
+        STREAM_DROP,      // Пропустить вытесненные события и продолжить с самого старого доступного
+        STREAM_DISCONNECT // Закрыть соединение; EventSource переподключится сам с Last-Event-ID
+    };
+
+    // Общее для всех подписчиков кольцо готовых событий Server-Sent Events. Событие кодируется
+    // один раз в Publish, подписчики получают ссылки на одну и ту же строку. Номера событий растут
+    // с 1 и служат их id. О новых событиях сообщает eventfd (Linux), который слушает epoll сервера
+    class EventStream
+    {
+    public:
+        explicit EventStream(size_t capacity = STREAM_RING_SIZE, StreamPolicy policy = STREAM_DROP)
+            : m_ring(std::max<size_t>(capacity, 1)), m_policy(policy)
+        {
+#ifndef WIN32
+            m_notify_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+#endif
+        }
+
+        ~EventStream()
+        {
+#ifndef WIN32
+            if (m_notify_fd >= 0) close(m_notify_fd);
+#endif
+        }
+
+        EventStream(const EventStream &) = delete;
+        EventStream &operator=(const EventStream &) = delete;
+
+        // Публикует событие типа event; многострочные data передаются несколькими строками "data:"
+        void Publish(const std::string &event, const std::string &data)
+        {
+            std::string encoded;
+            encoded.reserve(event.size() + data.size() + 48);
+            encoded.append("event: ").append(event).append("\n");
+            size_t line = 0;
+            size_t newline;
+            while ((newline = data.find('\n', line)) != std::string::npos)
+            {
+                encoded.append("data: ").append(data, line, newline - line).append("\n");
+                line = newline + 1;
+            }
+            encoded.append("data: ").append(data, line, std::string::npos).append("\n");
+
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                uint64_t id = ++m_last_id;
+                encoded.append("id: ").append(std::to_string(id)).append("\n\n");
+                m_ring[id % m_ring.size()] = std::make_shared<const std::string>(std::move(encoded));
+            }
+
+#ifndef WIN32
+            // Одно уведомление на пачку событий, пока сервер его не забрал
+            if (m_notify_fd >= 0 && !m_notified.exchange(true))
+            {
+                uint64_t one = 1;
+                ssize_t res = write(m_notify_fd, &one, sizeof(one));
+                (void)res;
+            }
+#endif
+        }
+
+        // Дописывает в events события с номерами от next_id, не более max_count, и сдвигает next_id.
+        // Возвращает число событий, вытесненных из кольца до того, как подписчик их забрал
+        uint64_t Read(uint64_t &next_id, std::vector<std::shared_ptr<const std::string>> &events, size_t max_count) const
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            uint64_t oldest = m_last_id >= m_ring.size() ? m_last_id - m_ring.size() + 1 : 1;
+            uint64_t skipped = 0;
+            if (next_id < oldest)
+            {
+                skipped = oldest - next_id;
+                next_id = oldest;
+            }
+            for (; next_id <= m_last_id && max_count > 0; ++next_id, --max_count)
+            {
+                events.push_back(m_ring[next_id % m_ring.size()]);
+            }
+            return skipped;
+        }
+
+        uint64_t GetLastId() const
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            return m_last_id;
+        }
+
+        // Номер самого старого события, ещё лежащего в кольце
+        uint64_t GetOldestId() const
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            return m_last_id >= m_ring.size() ? m_last_id - m_ring.size() + 1 : 1;
+        }
+
+        StreamPolicy GetPolicy() const { return m_policy; }
+        int GetNotifyFd() const { return m_notify_fd; }
+
+        // Забирает уведомление; вызывается потоком сервера перед рассылкой
+        void ClearNotify()
+        {
+#ifndef WIN32
+            m_notified.store(false);
+            uint64_t value = 0;
+            ssize_t res = read(m_notify_fd, &value, sizeof(value));
+            (void)res;
+#endif
+        }
+
+    private:
+        mutable std::mutex m_mutex; // Защищает кольцо и m_last_id
+        std::vector<std::shared_ptr<const std::string>> m_ring;
+        uint64_t m_last_id = 0;
+        StreamPolicy m_policy;
+        int m_notify_fd = -1;
+        std::atomic<bool> m_notified{false};
+    };
+
+    class SocketBase
+{
+public:
+    // Конструктор, инициализирующий сокет
+    SocketBase() : m_socket(INVALID_SOCKET)
+    {
+#ifdef WIN32
+        WSADATA wsaData;
+        WSAStartup(MAKEWORD(2, 2), &wsaData);
+#else
+        signal(SIGPIPE, SIG_IGN);
+#endif
+    }
+
+    // Деструктор, закрывающий сокет
+    ~SocketBase()
+    {
+        CloseSocket();
+#if defined(WIN32)
+        WSACleanup();
+#endif
+    }
+
+    // Получаем код последней ошибки
+    static int GetErrorCode()
     {
 #ifdef WIN32
         return WSAGetLastError();
@@ -348,11 +1436,11 @@ protected:
     }
 
     // Проверяем активность сокета
-    static int Poll(const SOCKET &socket, int timeout_ms = READ_WAIT_MS)
+    static int Poll(const SOCKET &socket, int timeout_ms = READ_WAIT_MS, short events = POLLIN)
     {
         struct pollfd pollStruct = {}; // Обнуляем структуру
         pollStruct.fd = socket; // Устанавливаем сокет
-        pollStruct.events = POLLIN; // Проверяем на доступные данные
+        pollStruct.events = events; // Проверяем на доступные данные
 
 #ifdef WIN32
         return WSAPoll(&pollStruct, 1, timeout_ms);
@@ -361,6 +1449,131 @@ protected:
 #endif
     }
 
+    // Отправляет весь буфер, дожидаясь готовности сокета при частичной записи
+    static bool SendAll(SOCKET sock, const char *data, size_t length)
+    {
+        while (length > 0)
+        {
+            int result = send(sock, data, (int)length, 0);
+            if (result == SOCKET_ERROR)
+            {
+                int error = GetErrorCode();
+#ifdef WIN32
+                bool would_block = error == WSAEWOULDBLOCK;
+#else
+                if (error == EINTR) continue;
+                bool would_block = error == EAGAIN || error == EWOULDBLOCK;
+#endif
+                if (!would_block || Poll(sock, WRITE_WAIT_MS, POLLOUT) <= 0)
+                {
+                    return false;
+                }
+                continue;
+            }
+            data += result;
+            length -= result;
+        }
+        return true;
+    }
+
+    // Отправляет два буфера одним вызовом writev с дозаписью при частичной отправке
+    static bool SendBuffers(SOCKET sock, const char *first, size_t first_length, const char *second, size_t second_length)
+    {
+#ifdef WIN32
+        return SendAll(sock, first, first_length) && SendAll(sock, second, second_length);
+#else
+        struct iovec iov[2];
+        iov[0].iov_base = (void *)first;
+        iov[0].iov_len = first_length;
+        iov[1].iov_base = (void *)second;
+        iov[1].iov_len = second_length;
+
+        struct iovec *current = iov;
+        int count = 2;
+        while (count > 0)
+        {
+            if (current->iov_len == 0)
+            {
+                ++current;
+                --count;
+                continue;
+            }
+
+            ssize_t result = writev(sock, current, count);
+            if (result < 0)
+            {
+                int error = GetErrorCode();
+                if (error == EINTR) continue;
+                if ((error != EAGAIN && error != EWOULDBLOCK) || Poll(sock, WRITE_WAIT_MS, POLLOUT) <= 0)
+                {
+                    return false;
+                }
+                continue;
+            }
+
+            // Сдвигаем буферы на отправленное число байт
+            size_t written = (size_t)result;
+            while (count > 0 && written >= current->iov_len)
+            {
+                written -= current->iov_len;
+                ++current;
+                --count;
+            }
+            if (count > 0)
+            {
+                current->iov_base = (char *)current->iov_base + written;
+                current->iov_len -= written;
+            }
+        }
+        return true;
+#endif
+    }
+
+    // Отправляет до max_length байт файла через sendfile; в sent - сколько отправлено
+    static bool SendFile(SOCKET sock, const std::string &file_path, size_t max_length, size_t &sent)
+    {
+        sent = 0;
+#ifdef WIN32
+        std::ifstream file(file_path, std::ios::binary);
+        if (!file) return true; // Файл исчез - вызывающий увидит недостачу
+        char buf[65536];
+        while (sent < max_length && file)
+        {
+            file.read(buf, (std::streamsize)std::min(sizeof(buf), max_length - sent));
+            size_t count = (size_t)file.gcount();
+            if (count == 0) break;
+            if (!SendAll(sock, buf, count)) return false;
+            sent += count;
+        }
+        return true;
+#else
+        int fd = open(file_path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0) return true; // Файл исчез - вызывающий увидит недостачу
+
+        off_t offset = 0;
+        bool ok = true;
+        while (sent < max_length)
+        {
+            ssize_t result = sendfile(sock, fd, &offset, max_length - sent);
+            if (result < 0)
+            {
+                int error = GetErrorCode();
+                if (error == EINTR) continue;
+                if ((error != EAGAIN && error != EWOULDBLOCK) || Poll(sock, WRITE_WAIT_MS, POLLOUT) <= 0)
+                {
+                    ok = false;
+                    break;
+                }
+                continue;
+            }
+            if (result == 0) break; // Конец файла
+            sent += (size_t)result;
+        }
+        close(fd);
+        return ok;
+#endif
+    }
+
     SOCKET m_socket;
 };
 
@@ -371,6 +1584,7 @@ public:
     // Конструктор, который запускает сервер
     HTTPServer(const std::string &ip, const short int port)
     {
+        InitMetrics();
         Listen(ip, port);
     }
 
@@ -435,6 +1649,7 @@ public:
         SOCKET client_socket = accept(m_socket, NULL, NULL);
         if (client_socket == INVALID_SOCKET)
         {
+            m_accept_errors->Add();
             std::cerr << "Client error: " << GetErrorCode() << std::endl;
             CloseSocket(client_socket);
             return;
@@ -446,78 +1661,1044 @@ public:
             return;
         }
 
-        std::stringstream recv_str;
-        int buf_size = sizeof(m_input_buf) - 1;
-        int result = -1;
-
+        // Дочитываем, пока запрос не разобран целиком: он может прийти несколькими пакетами
+        std::string input;
+        RequestParser parser;
+        auto status = RequestParser::PARSE_INCOMPLETE;
+        int result = 0;
         do
         {
-            result = recv(client_socket, m_input_buf, buf_size, 0);
-            if (result < 0)
-            {
-                break; // Если ошибка, выходим
-            }
-            m_input_buf[result] = '\0'; // Завершаем строку
-            recv_str << m_input_buf; // Добавляем в строку
-        } while (result >= buf_size);
-
-        if (result <= 0)
+            result = recv(client_socket, m_input_buf, sizeof(m_input_buf), 0);
+            if (result <= 0) break;
+            input.append(m_input_buf, result);
+            status = parser.Parse(input);
+        } while (status == RequestParser::PARSE_INCOMPLETE && Poll(client_socket) > 0);
+
+        auto start = std::chrono::steady_clock::now();
+        if (status == RequestParser::PARSE_INCOMPLETE)
         {
-            std::cerr << "Error retrieving data: " << GetErrorCode() << std::endl;
+            m_recv_errors->Add();
+            std::cerr << "Error retrieving data: " << (result < 0 ? GetErrorCode() : 0) << std::endl;
             CloseSocket(client_socket);
             return;
         }
 
-        auto request = Request(recv_str.str());
-        int index_r = -1;
-        for (uint64_t i = 0; i < m_sp_responses.size(); ++i)
+        Reply reply;
+        bool keep_alive = false;
+        if (status == RequestParser::PARSE_ERROR)
+        {
+            if (parser.IsTooLarge()) m_oversized_requests->Add();
+            reply = GetErrorReply(parser.GetError());
+        }
+        else
+        {
+            Request request(std::string_view(input).substr(0, parser.GetLength()), parser);
+            reply = GetResponse(request, keep_alive);
+            if (reply.stream) SetNotFound(reply, keep_alive); // Потоки событий - только в событийном режиме
+        }
+        bool sent = SendReply(client_socket, reply);
+        if (!sent)
+        {
+            std::cerr << "Sending error: " << GetErrorCode() << std::endl;
+        }
+        ObserveReply(reply, sent, start);
+        CloseSocket(client_socket);
+    }
+
+    // Формирование ответа на запрос: маршруты, затем статические файлы.
+    // Текстовые тела сжимаются, если клиент принимает gzip или deflate.
+    // keep_alive сбрасывается, если по ответу нельзя сохранить соединение (raw-ответ)
+    Reply GetResponse(Request &request, bool &keep_alive) const
+    {
+        ContentEncoding encoding = request.GetAcceptedEncoding();
+        Reply reply;
+        int route = m_router.Match(request);
+        if (route >= 0)
         {
-            if (request.CheckResponse(m_sp_responses[i]))
+            reply.route = ROUTE_SPECIAL + route;
+            ResponseWriter writer;
+            try
+            {
+                m_router.GetHandler(route)(request, writer);
+            }
+            catch (const std::exception &e)
+            {
+                std::cerr << "Handler error (" << request.GetURL() << "): " << e.what() << std::endl;
+                writer = ResponseWriter();
+                writer.SetResponseType("500 Internal Server Error");
+            }
+
+            switch (writer.GetBodyType())
             {
-                index_r = i; // Находим ответ
+            case BODY_STREAM:
+                if (IsRegisteredStream(writer.GetStream()))
+                {
+                    reply.stream = writer.GetStream();
+                    return reply;
+                }
+                std::cerr << "Stream is not available: " << request.GetURL() << std::endl;
+                SetNotFound(reply, keep_alive);
+                break;
+            case BODY_RAW:
+                keep_alive = false; // Границы raw-ответа неизвестны, соединение закрываем
+                reply.head = std::make_shared<const std::string>(std::move(writer.GetBody()));
+                break;
+            case BODY_FILES:
+                SetKeepAlive(writer, keep_alive);
+                reply.files = std::move(writer.GetFiles());
+                reply.last_open = writer.IsLastFileOpen();
+                GetFilesSize(reply);
+                EncodeFiles(reply, writer, encoding);
+                reply.head = std::make_shared<const std::string>(writer.GetHead(GetReplySize(reply)));
+                break;
+            case BODY_PARTS:
+                SetKeepAlive(writer, keep_alive);
+                reply.body = std::make_shared<const std::string>(EncodeParts(writer.GetParts(), writer, encoding));
+                reply.head = std::make_shared<const std::string>(writer.GetHead(reply.body->length()));
+                break;
+            case BODY_TEXT:
+                SetKeepAlive(writer, keep_alive);
+                EncodeDynamicBody(writer.GetBody(), writer, encoding);
+                reply.body = std::make_shared<const std::string>(std::move(writer.GetBody()));
+                reply.head = std::make_shared<const std::string>(writer.GetHead(reply.body->length()));
                 break;
             }
         }
-
-        std::string response;
-        if (index_r != -1)
+        else if (auto cached = m_static_cache.Find(std::string(request.GetURL()), keep_alive, encoding))
         {
-            response = m_sp_responses[index_r].IsRaw() ? 
-                m_sp_responses[index_r].GetBody() : 
-                m_sp_responses[index_r].GetAnswer();
+            reply.route = ROUTE_STATIC;
+            reply.head = cached;
         }
         else
         {
             std::string path = request.GetFileURL();
             if (!path.empty())
             {
-                response = Response(request).GetAnswer(utillib::ReadFile(path));
+                reply.route = ROUTE_FILE;
+                Response file_response(request);
+                SetKeepAlive(file_response, keep_alive);
+                reply.files = {path};
+                GetFilesSize(reply);
+                EncodeFiles(reply, file_response, encoding);
+                reply.head = std::make_shared<const std::string>(file_response.GetHead(GetReplySize(reply)));
             }
             else
             {
-                response = error_response.GetAnswer();
+                SetNotFound(reply, keep_alive);
             }
         }
+        return reply;
+    }
+
+    // Ответ на запрос, который не удалось разобрать; соединение после него закрывается
+    Reply GetErrorReply(const std::string &status) const
+    {
+        Reply reply;
+        reply.route = ROUTE_BAD_REQUEST;
+        Response response(status, "text/html");
+        response.SetKeepAlive(false);
+        reply.head = std::make_shared<const std::string>(response.GetAnswer("<html><body>" + status + "</body></html>"));
+        return reply;
+    }
+
+    void SetNotFound(Reply &reply, bool keep_alive) const
+    {
+        reply.route = ROUTE_NOT_FOUND;
+        ErrorResponse not_found = error_response;
+        SetKeepAlive(not_found, keep_alive);
+        reply.head = std::make_shared<const std::string>(not_found.GetAnswer());
+    }
+
+    // Потоки событий рассылаются только в событийном режиме и только зарегистрированные
+    bool IsRegisteredStream(const EventStream *stream) const
+    {
+#ifndef WIN32
+        return std::find(m_streams.begin(), m_streams.end(), stream) != m_streams.end();
+#else
+        (void)stream;
+        return false;
+#endif
+    }
 
+    // Сжимает тело, собранное для этого запроса (быстрым уровнем, без кэша)
+    static void EncodeDynamicBody(std::string &body, Response &response, ContentEncoding encoding)
+    {
+        if (!IsCompressibleType(response.GetContentType()) || body.size() < COMPRESS_MIN_SIZE) return;
 
-        result = send(client_socket, response.c_str(), (int)response.length(), 0);
-        if (result == SOCKET_ERROR)
+        response.SetEncoding(ENCODING_IDENTITY);
+        std::string encoded;
+        if (EncodeBody(body, encoding, COMPRESS_LEVEL_DYNAMIC, encoded))
         {
-            std::cerr << "Sending error: " << GetErrorCode() << std::endl;
+            body.swap(encoded);
+            response.SetEncoding(encoding);
         }
-        CloseSocket(client_socket);
-        std::cout << "Reply sent <3" << std::endl;
     }
 
-    // Метод для регистрации ответов
-    void RegisterResponses(std::vector<SpecialResponse> responses)
+    // Заменяет файлы ответа сжатым телом. Сжатый файл кэшируется по пути, размеру и времени изменения,
+    // так что неизменные файлы (запечатанные сегменты логов, статика вне кэша) сжимаются один раз.
+    // Дописываемый файл меняется с каждой записью: он сжимается быстрым уровнем мимо кэша.
+    // При ошибке файлы остаются и уходят через sendfile без сжатия
+    void EncodeFiles(Reply &reply, Response &response, ContentEncoding encoding) const
     {
-        m_sp_responses = responses; // Сохраняем ответы
-    }
+        if (!IsCompressibleType(response.GetContentType()) || reply.files_size < COMPRESS_MIN_SIZE ||
+            reply.files_size > COMPRESS_MAX_FILE_SIZE)
+        {
+            return;
+        }
+        response.SetEncoding(ENCODING_IDENTITY);
+        if (encoding == ENCODING_IDENTITY) return;
 
-private:
-    char m_input_buf[1024]; // Буфер для данных
-    std::vector<SpecialResponse> m_sp_responses; // Ответы
+        std::vector<std::shared_ptr<const DeflateChunk>> chunks;
+        try
+        {
+            for (size_t i = 0; i < reply.files.size(); ++i)
+            {
+                const std::string &path = reply.files[i];
+                size_t size = reply.file_sizes[i];
+                std::error_code ec;
+                auto mtime = fs::last_write_time(path, ec).time_since_epoch().count();
+                std::string version = std::to_string(size) + ":" + std::to_string(mtime);
+                // Дописанное после GetFilesSize не отправляется, как и при sendfile
+                auto text = [&path, size]() { return utillib::ReadFile(path).substr(0, size); };
+                std::shared_ptr<const DeflateChunk> chunk;
+                if (reply.last_open && i + 1 == reply.files.size())
+                {
+                    auto fresh = std::make_shared<DeflateChunk>();
+                    if (CompressChunk(text(), COMPRESS_LEVEL_DYNAMIC, *fresh)) chunk = fresh;
+                }
+                else
+                {
+                    chunk = m_compression_cache.Get("file:" + path, version, text);
+                }
+                if (!chunk) return;
+                chunks.push_back(chunk);
+            }
+        }
+        catch (const std::exception &e)
+        {
+            std::cerr << "Compression error: " << e.what() << std::endl;
+            return;
+        }
+
+        reply.body = std::make_shared<const std::string>(BuildEncodedBody(chunks, encoding));
+        reply.files.clear();
+        reply.file_sizes.clear();
+        reply.files_size = 0;
+        response.SetEncoding(encoding);
+    }
+
+    // Тело из частей: сжатые куски неизменных частей берутся из кэша, остальные сжимаются быстрым уровнем.
+    // Без сжатия - части подряд
+    std::string EncodeParts(const std::vector<BodyPart> &parts, Response &response, ContentEncoding encoding) const
+    {
+        bool compressible = IsCompressibleType(response.GetContentType());
+        response.SetEncoding(ENCODING_IDENTITY, compressible);
+        if (compressible && encoding != ENCODING_IDENTITY)
+        {
+            std::vector<std::shared_ptr<const DeflateChunk>> chunks;
+            for (const auto &part : parts)
+            {
+                std::shared_ptr<const DeflateChunk> chunk;
+                if (!part.key.empty())
+                {
+                    chunk = m_compression_cache.Get("part:" + part.key, "", part.text);
+                }
+                else
+                {
+                    auto fresh = std::make_shared<DeflateChunk>();
+                    if (CompressChunk(part.text(), COMPRESS_LEVEL_DYNAMIC, *fresh)) chunk = fresh;
+                }
+                if (!chunk) break;
+                chunks.push_back(chunk);
+            }
+            if (chunks.size() == parts.size())
+            {
+                response.SetEncoding(encoding);
+                return BuildEncodedBody(chunks, encoding);
+            }
+        }
+
+        std::string body;
+        for (const auto &part : parts)
+        {
+            body.append(part.text());
+        }
+        return body;
+    }
+
+    // Отправляет ответ: заголовки и тело из памяти одним writev, затем файлы через sendfile.
+    // false при ошибке или если файл укоротился и заявленный Content-Length не выдержан
+    static bool SendReply(SOCKET sock, const Reply &reply)
+    {
+        const std::string empty;
+        const std::string &head = reply.head ? *reply.head : empty;
+        const std::string &body = reply.body ? *reply.body : empty;
+        if (!SendBuffers(sock, head.data(), head.length(), body.data(), body.length()))
+        {
+            return false;
+        }
+
+        for (size_t i = 0; i < reply.files.size(); ++i)
+        {
+            size_t sent = 0;
+            if (!SendFile(sock, reply.files[i], reply.file_sizes[i], sent) || sent != reply.file_sizes[i])
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // Загружает статические файлы в кэш готовых ответов
+    void LoadStaticCache()
+    {
+        m_static_cache.Load(m_keep_alive_timeout, m_keep_alive_max);
+    }
+
+    // Параметры постоянных соединений: таймаут простоя и предел запросов на соединение
+    void SetKeepAliveLimits(int timeout_sec, int max_requests)
+    {
+        m_keep_alive_timeout = timeout_sec;
+        m_keep_alive_max = max_requests;
+        if (m_static_cache.IsLoaded())
+        {
+            LoadStaticCache(); // Заголовки в кэше зависят от этих параметров
+        }
+    }
+
+    // Событийный режим: неблокирующий слушающий сокет на epoll и пул рабочих потоков.
+    // Возвращает управление, только если сокет стал невалидным
+    void Run(size_t worker_count = DEFAULT_WORKER_COUNT)
+    {
+#ifdef WIN32
+        (void)worker_count;
+        while (IsValid())
+        {
+            ProcessClient();
+        }
+#else
+        if (!IsValid())
+        {
+            std::cerr << "The socket is not valid." << std::endl;
+            return;
+        }
+
+        m_epoll = epoll_create1(EPOLL_CLOEXEC);
+        if (m_epoll < 0)
+        {
+            std::cerr << "Epoll error: " << GetErrorCode() << std::endl;
+            return;
+        }
+
+        SetNonBlocking(m_socket);
+        struct epoll_event listen_event = {};
+        listen_event.events = EPOLLIN;
+        listen_event.data.fd = m_socket;
+        epoll_ctl(m_epoll, EPOLL_CTL_ADD, m_socket, &listen_event);
+
+        int notify_fd = m_static_cache.GetNotifyFd();
+        if (notify_fd >= 0)
+        {
+            struct epoll_event notify_event = {};
+            notify_event.events = EPOLLIN;
+            notify_event.data.fd = notify_fd;
+            epoll_ctl(m_epoll, EPOLL_CTL_ADD, notify_fd, &notify_event);
+        }
+
+        for (auto &stream : m_streams)
+        {
+            struct epoll_event stream_event = {};
+            stream_event.events = EPOLLIN;
+            stream_event.data.fd = stream->GetNotifyFd();
+            epoll_ctl(m_epoll, EPOLL_CTL_ADD, stream_event.data.fd, &stream_event);
+        }
+
+        utillib::ThreadPool workers(worker_count);
+        struct epoll_event events[EPOLL_MAX_EVENTS];
+
+        while (IsValid())
+        {
+            int count = epoll_wait(m_epoll, events, EPOLL_MAX_EVENTS, IDLE_SWEEP_MS);
+            if (count < 0)
+            {
+                if (GetErrorCode() == EINTR) continue;
+                std::cerr << "Epoll wait error: " << GetErrorCode() << std::endl;
+                break;
+            }
+
+            for (int i = 0; i < count; ++i)
+            {
+                SOCKET fd = events[i].data.fd;
+                if (fd == m_socket)
+                {
+                    AcceptClients();
+                }
+                else if (fd == notify_fd)
+                {
+                    // Файлы перечитываются и сжимаются в рабочем потоке, цикл событий их не ждёт
+                    auto changes = m_static_cache.ReadEvents();
+                    if (!changes.empty())
+                    {
+                        workers.Push([this, changes]() { m_static_cache.ApplyEvents(changes); });
+                    }
+                }
+                else if (EventStream *stream = FindStreamByNotifyFd(fd))
+                {
+                    stream->ClearNotify();
+                    FlushSubscribers(stream);
+                }
+                else if (!ServeSubscriber(fd, events[i].events) && AcquireConnection(fd))
+                {
+                    workers.Push([this, fd]() { ServeConnection(fd); });
+                }
+            }
+
+            CloseIdleConnections();
+            PingSubscribers();
+        }
+
+        close(m_epoll);
+        m_epoll = -1;
+#endif
+    }
+
+    // Маршрут method + pattern: точный путь ("/series"), шаблон с параметрами ("/sensors/:id/series")
+    // или префикс ("/files/*"). Регистрировать до запуска сервера
+    void RegisterRoute(const std::string &method, const std::string &pattern, Handler handler)
+    {
+        m_router.Add(method, pattern, std::move(handler));
+        m_route_metrics.push_back(GetRouteMetrics(pattern, method));
+    }
+
+    // Поток событий по адресу url (GET): соединение остаётся открытым, и события из stream
+    // рассылаются всем подписчикам из потока epoll. Только в событийном режиме (не WIN32).
+    // Обработчики других маршрутов тоже могут перевести соединение в этот поток (ResponseWriter::Stream)
+    void RegisterStream(const std::string &url, EventStream &stream)
+    {
+        m_streams.push_back(&stream);
+        RegisterRoute("GET", url, [&stream](const Request &, ResponseWriter &writer) { writer.Stream(stream); });
+    }
+
+private:
+#ifndef WIN32
+    // Ответ, который сокет принял не целиком: остаток дописывается по EPOLLOUT
+    struct Output
+    {
+        Reply reply;
+        std::chrono::steady_clock::time_point start; // Начало обработки запроса, для метрик
+        size_t sent = 0; // Отправлено байт заголовков и тела из памяти
+        size_t file = 0; // Номер отправляемого файла
+        off_t file_offset = 0; // Отправлено байт текущего файла
+        int file_fd = -1;
+    };
+
+    // Состояние соединения в событийном режиме
+    struct Connection
+    {
+        std::string input; // Накопленные данные запросов
+        RequestParser parser; // Разбор первого запроса в input, продолжается при дочитывании
+        std::optional<Output> output; // Недописанный ответ; следующие запросы ждут его
+        bool closing = false; // Закрыть соединение, когда ответ будет дописан
+        int requests = 0; // Обработано запросов на соединении
+        bool busy = false; // Соединение обрабатывается рабочим потоком
+        std::chrono::steady_clock::time_point last_active = std::chrono::steady_clock::now();
+
+        ~Connection()
+        {
+            if (output && output->file_fd >= 0) close(output->file_fd);
+        }
+    };
+
+    static void SetNonBlocking(SOCKET sock)
+    {
+        int flags = fcntl(sock, F_GETFL, 0);
+        fcntl(sock, F_SETFL, flags | O_NONBLOCK);
+    }
+
+    // Принимает все ожидающие соединения и регистрирует их в epoll
+    void AcceptClients()
+    {
+        while (true)
+        {
+            SOCKET client_socket = accept4(m_socket, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+            if (client_socket == INVALID_SOCKET)
+            {
+                int error = GetErrorCode();
+                if (error != EAGAIN && error != EWOULDBLOCK && error != EINTR)
+                {
+                    m_accept_errors->Add();
+                    std::cerr << "Client error: " << error << std::endl;
+                }
+                if (error == EINTR) continue;
+                return;
+            }
+
+            std::lock_guard<std::mutex> lock(m_conn_mutex);
+            m_connections[client_socket] = std::make_shared<Connection>();
+
+            struct epoll_event client_event = {};
+            client_event.events = EPOLLIN | EPOLLRDHUP | EPOLLONESHOT;
+            client_event.data.fd = client_socket;
+            if (epoll_ctl(m_epoll, EPOLL_CTL_ADD, client_socket, &client_event) < 0)
+            {
+                m_connections.erase(client_socket);
+                CloseSocket(client_socket);
+            }
+        }
+    }
+
+    // Помечает соединение занятым перед передачей в рабочий поток
+    bool AcquireConnection(SOCKET sock)
+    {
+        std::lock_guard<std::mutex> lock(m_conn_mutex);
+        auto it = m_connections.find(sock);
+        if (it == m_connections.end()) return false;
+        it->second->busy = true;
+        return true;
+    }
+
+    // Повторно включает ожидание на соединении (EPOLLONESHOT): данных или, пока ответ не дописан, места в сокете.
+    // Выполняется под m_conn_mutex, чтобы не пересечься с закрытием простаивающих соединений
+    void RearmConnection(SOCKET sock, const std::shared_ptr<Connection> &conn)
+    {
+        std::unique_lock<std::mutex> lock(m_conn_mutex);
+        conn->busy = false;
+        conn->last_active = std::chrono::steady_clock::now();
+
+        struct epoll_event client_event = {};
+        client_event.events = (conn->output ? (uint32_t)EPOLLOUT : (uint32_t)(EPOLLIN | EPOLLRDHUP)) | EPOLLONESHOT;
+        client_event.data.fd = sock;
+        if (epoll_ctl(m_epoll, EPOLL_CTL_MOD, sock, &client_event) < 0)
+        {
+            lock.unlock();
+            CloseConnection(sock);
+        }
+    }
+
+    // Закрывает соединения, простаивающие дольше таймаута keep-alive,
+    // и те, чей клиент не забирает ответ дольше WRITE_WAIT_MS
+    void CloseIdleConnections()
+    {
+        auto now = std::chrono::steady_clock::now();
+        std::chrono::steady_clock::duration idle_timeout = std::chrono::seconds(m_keep_alive_timeout);
+        std::chrono::steady_clock::duration write_timeout = std::chrono::milliseconds(WRITE_WAIT_MS);
+
+        std::lock_guard<std::mutex> lock(m_conn_mutex);
+        for (auto it = m_connections.begin(); it != m_connections.end();)
+        {
+            const Connection &conn = *it->second;
+            if (!conn.busy && now - conn.last_active >= (conn.output ? write_timeout : idle_timeout))
+            {
+                epoll_ctl(m_epoll, EPOLL_CTL_DEL, it->first, NULL);
+                CloseSocket(it->first);
+                it = m_connections.erase(it);
+            }
+            else
+            {
+                ++it;
+            }
+        }
+    }
+
+    void CloseConnection(SOCKET sock)
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_conn_mutex);
+            m_connections.erase(sock);
+        }
+        epoll_ctl(m_epoll, EPOLL_CTL_DEL, sock, NULL);
+        CloseSocket(sock);
+    }
+
+    // Выполняется в рабочем потоке: дочитывает данные и по очереди отвечает на все полные
+    // (в т.ч. конвейерные) запросы. Соединение остаётся открытым, если это разрешено keep-alive
+    void ServeConnection(SOCKET sock)
+    {
+        std::shared_ptr<Connection> conn;
+        {
+            std::lock_guard<std::mutex> lock(m_conn_mutex);
+            auto it = m_connections.find(sock);
+            if (it == m_connections.end()) return;
+            conn = it->second;
+        }
+
+        // Сначала дописываем ответ, на котором сокет переполнился; до этого новые запросы не разбираются
+        if (conn->output)
+        {
+            if (!FlushOutput(sock, *conn))
+            {
+                CloseConnection(sock);
+                return;
+            }
+            if (conn->output)
+            {
+                RearmConnection(sock, conn);
+                return;
+            }
+            if (conn->closing)
+            {
+                CloseConnection(sock);
+                return;
+            }
+        }
+
+        // Больше MAX_REQUEST_SIZE необработанных данных не читаем: остальное дождётся следующего события,
+        // а слишком длинный запрос отклонит разбор
+        char buf[4096];
+        bool peer_closed = false;
+        while (conn->input.size() <= MAX_REQUEST_SIZE)
+        {
+            ssize_t result = recv(sock, buf, sizeof(buf), 0);
+            if (result > 0)
+            {
+                conn->input.append(buf, result);
+                continue;
+            }
+            if (result < 0 && GetErrorCode() == EINTR) continue;
+            if (result < 0 && (GetErrorCode() == EAGAIN || GetErrorCode() == EWOULDBLOCK)) break;
+            // Клиент закрыл соединение или ошибка чтения
+            if (result < 0) m_recv_errors->Add();
+            peer_closed = true;
+            break;
+        }
+
+        size_t consumed = 0; // Байт input, занятых уже обработанными запросами
+        while (!conn->closing && !conn->output)
+        {
+            std::string_view pending = std::string_view(conn->input).substr(consumed);
+            auto status = conn->parser.Parse(pending);
+            if (status == RequestParser::PARSE_INCOMPLETE) break;
+
+            auto start = std::chrono::steady_clock::now();
+            ++conn->requests;
+            if (status == RequestParser::PARSE_ERROR)
+            {
+                if (conn->parser.IsTooLarge()) m_oversized_requests->Add();
+                conn->output = Output{GetErrorReply(conn->parser.GetError()), start};
+                conn->closing = true;
+                if (!FlushOutput(sock, *conn))
+                {
+                    CloseConnection(sock);
+                    return;
+                }
+                break;
+            }
+
+            size_t length = conn->parser.GetLength();
+            Request request(pending.substr(0, length), conn->parser);
+            conn->parser.Reset();
+            consumed += length;
+
+            bool keep_alive = request.IsKeepAlive() && conn->requests < m_keep_alive_max;
+            auto reply = GetResponse(request, keep_alive);
+            if (reply.stream)
+            {
+                // Подписчику больше не отвечают: запросы, присланные следом за переходом в поток, остались бы
+                // без ответа. Такой клиент получает 400, соединение закрывается
+                if (consumed < conn->input.size())
+                {
+                    reply = GetErrorReply("400 Bad Request");
+                    keep_alive = false;
+                }
+                else
+                {
+                    Subscribe(sock, request, reply.stream);
+                    return;
+                }
+            }
+            conn->output = Output{std::move(reply), start};
+            conn->closing = !keep_alive;
+            // Ответ, не поместившийся в сокет, допишется по EPOLLOUT: рабочий поток не ждёт медленного клиента
+            if (!FlushOutput(sock, *conn))
+            {
+                CloseConnection(sock);
+                return;
+            }
+        }
+        conn->input.erase(0, consumed);
+
+        if (conn->output)
+        {
+            RearmConnection(sock, conn);
+            return;
+        }
+        if (conn->closing || peer_closed)
+        {
+            CloseConnection(sock);
+            return;
+        }
+        RearmConnection(sock, conn);
+    }
+
+    enum WriteStatus
+    {
+        WRITE_DONE,
+        WRITE_BLOCKED, // Сокет переполнен, остаток - по EPOLLOUT
+        WRITE_FAILED
+    };
+
+    // Отправляет остаток ответа без ожидания: заголовки и тело из памяти одним writev, затем файлы через sendfile.
+    // Ошибка - и если файл укоротился и заявленный Content-Length не выдержан
+    static WriteStatus WriteOutput(SOCKET sock, Output &out)
+    {
+        const Reply &reply = out.reply;
+        const std::string empty;
+        const std::string &head = reply.head ? *reply.head : empty;
+        const std::string &body = reply.body ? *reply.body : empty;
+        while (out.sent < head.length() + body.length())
+        {
+            struct iovec iov[2];
+            int count = 0;
+            if (out.sent < head.length())
+            {
+                iov[count].iov_base = (void *)(head.data() + out.sent);
+                iov[count++].iov_len = head.length() - out.sent;
+            }
+            size_t body_sent = out.sent > head.length() ? out.sent - head.length() : 0;
+            if (body_sent < body.length())
+            {
+                iov[count].iov_base = (void *)(body.data() + body_sent);
+                iov[count++].iov_len = body.length() - body_sent;
+            }
+
+            ssize_t result = writev(sock, iov, count);
+            if (result < 0)
+            {
+                int error = GetErrorCode();
+                if (error == EINTR) continue;
+                return error == EAGAIN || error == EWOULDBLOCK ? WRITE_BLOCKED : WRITE_FAILED;
+            }
+            out.sent += (size_t)result;
+        }
+
+        while (out.file < reply.files.size())
+        {
+            size_t size = reply.file_sizes[out.file];
+            if (out.file_fd < 0)
+            {
+                out.file_fd = open(reply.files[out.file].c_str(), O_RDONLY | O_CLOEXEC);
+                if (out.file_fd < 0) return WRITE_FAILED; // Файл исчез
+            }
+            while ((size_t)out.file_offset < size)
+            {
+                ssize_t result = sendfile(sock, out.file_fd, &out.file_offset, size - (size_t)out.file_offset);
+                if (result < 0)
+                {
+                    int error = GetErrorCode();
+                    if (error == EINTR) continue;
+                    return error == EAGAIN || error == EWOULDBLOCK ? WRITE_BLOCKED : WRITE_FAILED;
+                }
+                if (result == 0) return WRITE_FAILED; // Файл укоротился
+            }
+            close(out.file_fd);
+            out.file_fd = -1;
+            out.file_offset = 0;
+            ++out.file;
+        }
+        return WRITE_DONE;
+    }
+
+    // Дописывает conn.output, пока сокет принимает данные; отправленный целиком ответ учитывается в метриках
+    // и убирается. false - ошибка отправки, соединение надо закрыть
+    bool FlushOutput(SOCKET sock, Connection &conn)
+    {
+        WriteStatus status = WriteOutput(sock, *conn.output);
+        if (status == WRITE_BLOCKED) return true;
+
+        if (status == WRITE_FAILED)
+        {
+            std::cerr << "Sending error: " << GetErrorCode() << std::endl;
+        }
+        ObserveReply(conn.output->reply, status == WRITE_DONE, conn.output->start);
+        if (conn.output->file_fd >= 0) close(conn.output->file_fd);
+        conn.output.reset();
+        return status == WRITE_DONE;
+    }
+
+    // Подписчик потока событий. Соединением занимается только поток epoll (под m_stream_mutex)
+    struct Subscriber
+    {
+        EventStream *stream = nullptr;
+        uint64_t next_id = 0; // Следующее событие для отправки
+        std::string pending; // Собранные для отправки события
+        size_t sent = 0; // Сколько байт pending уже принял сокет
+        bool want_write = false; // Ждём EPOLLOUT: сокет был переполнен
+        std::chrono::steady_clock::time_point last_send = std::chrono::steady_clock::now();
+    };
+
+    EventStream *FindStreamByNotifyFd(SOCKET fd) const
+    {
+        for (const auto &stream : m_streams)
+        {
+            if (stream->GetNotifyFd() == fd) return stream;
+        }
+        return nullptr;
+    }
+
+    // Выполняется в рабочем потоке: переводит соединение в подписчики. Первыми уходят заголовки ответа,
+    // затем события после Last-Event-ID (если они ещё в кольце) либо только новые
+    void Subscribe(SOCKET sock, const Request &request, EventStream *stream)
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_conn_mutex);
+            m_connections.erase(sock);
+        }
+
+        Subscriber sub;
+        sub.stream = stream;
+        sub.next_id = stream->GetLastId() + 1;
+        std::string last_event = request.GetHeader("Last-Event-ID", "");
+        char *end = NULL;
+        unsigned long long last_id = strtoull(last_event.c_str(), &end, 10);
+        if (!last_event.empty() && *end == '\0')
+        {
+            sub.next_id = std::clamp<uint64_t>(last_id + 1, stream->GetOldestId(), sub.next_id);
+        }
+        sub.pending = std::string(request.GetVersion()) + " 200 OK\r\n"
+                      "Content-Type: text/event-stream\r\n"
+                      "Cache-Control: no-cache\r\n"
+                      "Connection: keep-alive\r\n\r\n";
+
+        std::lock_guard<std::mutex> lock(m_stream_mutex);
+        Subscriber &added = m_subscribers[sock] = std::move(sub);
+        m_stream_subscribers->Add(1);
+
+        struct epoll_event client_event = {};
+        client_event.events = EPOLLIN | EPOLLRDHUP;
+        client_event.data.fd = sock;
+        if (epoll_ctl(m_epoll, EPOLL_CTL_MOD, sock, &client_event) < 0)
+        {
+            CloseSubscriber(sock);
+            return;
+        }
+        FlushSubscriber(sock, added);
+    }
+
+    // Вызывается под m_stream_mutex; sub после этого недействителен
+    void CloseSubscriber(SOCKET sock)
+    {
+        epoll_ctl(m_epoll, EPOLL_CTL_DEL, sock, NULL);
+        CloseSocket(sock);
+        m_subscribers.erase(sock);
+        m_stream_subscribers->Add(-1);
+    }
+
+    // Ожидание EPOLLOUT включается, только пока сокет подписчика переполнен
+    bool SetSubscriberWrite(SOCKET sock, Subscriber &sub, bool want_write)
+    {
+        if (sub.want_write == want_write) return true;
+        sub.want_write = want_write;
+
+        struct epoll_event client_event = {};
+        client_event.events = EPOLLIN | EPOLLRDHUP | (want_write ? (uint32_t)EPOLLOUT : 0u);
+        client_event.data.fd = sock;
+        if (epoll_ctl(m_epoll, EPOLL_CTL_MOD, sock, &client_event) < 0)
+        {
+            CloseSubscriber(sock);
+            return false;
+        }
+        return true;
+    }
+
+    // Отправляет подписчику накопившиеся события, пока сокет их принимает. Вызывается под m_stream_mutex.
+    // Память на подписчика ограничена пачкой из STREAM_MAX_BATCH событий: отставший больше чем на кольцо
+    // теряет вытесненные события (STREAM_DROP) или отключается (STREAM_DISCONNECT). false - подписчик закрыт
+    bool FlushSubscriber(SOCKET sock, Subscriber &sub)
+    {
+        std::vector<std::shared_ptr<const std::string>> events;
+        while (true)
+        {
+            if (sub.sent == sub.pending.size())
+            {
+                sub.pending.clear();
+                sub.sent = 0;
+                events.clear();
+                uint64_t skipped = sub.stream->Read(sub.next_id, events, STREAM_MAX_BATCH);
+                if (skipped > 0)
+                {
+                    m_stream_dropped->Add(skipped);
+                    if (sub.stream->GetPolicy() == STREAM_DISCONNECT)
+                    {
+                        m_stream_slow_disconnects->Add();
+                        CloseSubscriber(sock);
+                        return false;
+                    }
+                }
+                for (const auto &event : events)
+                {
+                    sub.pending.append(*event);
+                }
+                if (sub.pending.empty()) break;
+            }
+
+            ssize_t result = send(sock, sub.pending.data() + sub.sent, sub.pending.size() - sub.sent, MSG_NOSIGNAL | MSG_DONTWAIT);
+            if (result > 0)
+            {
+                sub.sent += result;
+                sub.last_send = std::chrono::steady_clock::now();
+                m_sent_bytes->Add(result);
+                continue;
+            }
+            if (result < 0 && GetErrorCode() == EINTR) continue;
+            if (result < 0 && (GetErrorCode() == EAGAIN || GetErrorCode() == EWOULDBLOCK))
+            {
+                return SetSubscriberWrite(sock, sub, true);
+            }
+            CloseSubscriber(sock);
+            return false;
+        }
+        return SetSubscriberWrite(sock, sub, false);
+    }
+
+    void FlushSubscribers(EventStream *stream)
+    {
+        std::lock_guard<std::mutex> lock(m_stream_mutex);
+        for (auto it = m_subscribers.begin(); it != m_subscribers.end();)
+        {
+            auto next = std::next(it); // Подписчик может быть закрыт и удалён
+            if (it->second.stream == stream) FlushSubscriber(it->first, it->second);
+            it = next;
+        }
+    }
+
+    // Событие epoll на соединении подписчика; false - это не подписчик.
+    // Подписчик ничего не присылает: входящие данные выбрасываются, закрытие соединения отключает его
+    bool ServeSubscriber(SOCKET sock, uint32_t events)
+    {
+        std::lock_guard<std::mutex> lock(m_stream_mutex);
+        auto it = m_subscribers.find(sock);
+        if (it == m_subscribers.end()) return false;
+
+        if (events & (EPOLLRDHUP | EPOLLHUP | EPOLLERR))
+        {
+            CloseSubscriber(sock);
+            return true;
+        }
+        if (events & EPOLLIN)
+        {
+            char buf[512];
+            ssize_t result;
+            while ((result = recv(sock, buf, sizeof(buf), 0)) > 0)
+            {
+            }
+            if (result == 0 || (GetErrorCode() != EAGAIN && GetErrorCode() != EWOULDBLOCK && GetErrorCode() != EINTR))
+            {
+                CloseSubscriber(sock);
+                return true;
+            }
+        }
+        if (events & EPOLLOUT)
+        {
+            FlushSubscriber(sock, it->second);
+        }
+        return true;
+    }
+
+    // Простаивающим подписчикам - комментарий SSE: без него оборванное соединение не обнаружить
+    void PingSubscribers()
+    {
+        auto now = std::chrono::steady_clock::now();
+        std::lock_guard<std::mutex> lock(m_stream_mutex);
+        for (auto it = m_subscribers.begin(); it != m_subscribers.end();)
+        {
+            auto next = std::next(it);
+            Subscriber &sub = it->second;
+            if (sub.sent == sub.pending.size() && now - sub.last_send >= std::chrono::seconds(STREAM_PING_SEC))
+            {
+                sub.pending = ":\n\n";
+                sub.sent = 0;
+                FlushSubscriber(it->first, sub);
+            }
+            it = next;
+        }
+    }
+
+    int m_epoll = -1; // Дескриптор epoll
+    std::mutex m_stream_mutex; // Защищает m_subscribers
+    std::unordered_map<SOCKET, Subscriber> m_subscribers; // Подписчики потоков событий
+    std::mutex m_conn_mutex; // Защищает m_connections
+    std::unordered_map<SOCKET, std::shared_ptr<Connection>> m_connections; // Открытые соединения
+#endif
+
+    int m_keep_alive_timeout = KEEP_ALIVE_TIMEOUT_SEC; // Таймаут простоя соединения, с
+    int m_keep_alive_max = KEEP_ALIVE_MAX_REQUESTS; // Максимум запросов на соединение
+    StaticCache m_static_cache; // Готовые ответы для html/ и js/
+    mutable CompressionCache m_compression_cache; // Сжатые файлы и неизменные части ответов
+
+    // Выставляет заголовки соединения с учётом настроек сервера
+    void SetKeepAlive(Response &response, bool keep_alive) const
+    {
+        response.SetKeepAlive(keep_alive, m_keep_alive_timeout, m_keep_alive_max);
+    }
+
+    // Маршруты для метрик: встроенные (кэш статики, файлы, 404, неразобранные запросы), затем зарегистрированные маршруты по порядку
+    enum Route
+    {
+        ROUTE_STATIC,
+        ROUTE_FILE,
+        ROUTE_NOT_FOUND,
+        ROUTE_BAD_REQUEST,
+        ROUTE_SPECIAL
+    };
+
+    struct RouteMetrics
+    {
+        utillib::Counter *requests;
+        utillib::Histogram *latency; // От начала разбора запроса до отправки ответа, с
+    };
+
+    static RouteMetrics GetRouteMetrics(const std::string &route, const std::string &method)
+    {
+        std::string labels = utillib::MetricLabel("route", route) + "," + utillib::MetricLabel("method", method);
+        return {&utillib::Metrics().GetCounter("http_requests_total", "HTTP requests by route.", labels),
+                &utillib::Metrics().GetHistogram("http_request_duration_seconds", "Time to parse a request and send the reply.", labels)};
+    }
+
+    void InitMetrics()
+    {
+        auto &metrics = utillib::Metrics();
+        m_route_metrics = {GetRouteMetrics("static", "GET"), GetRouteMetrics("file", "GET"), GetRouteMetrics("not_found", "*"),
+                          GetRouteMetrics("bad_request", "*")};
+        m_sent_bytes = &metrics.GetCounter("http_response_bytes_total", "Bytes of replies sent successfully.");
+        m_send_errors = &metrics.GetCounter("http_send_errors_total", "Replies that failed to send.");
+        m_accept_errors = &metrics.GetCounter("http_accept_errors_total", "Failed accept calls.");
+        m_recv_errors = &metrics.GetCounter("http_recv_errors_total", "Failed recv calls on client connections.");
+        m_oversized_requests = &metrics.GetCounter("http_oversized_requests_total", "Requests rejected for exceeding size limits.");
+        m_stream_subscribers = &metrics.GetGauge("http_stream_subscribers", "Open event stream connections.");
+        m_stream_dropped = &metrics.GetCounter("http_stream_dropped_events_total", "Events overwritten before a slow subscriber read them.");
+        m_stream_slow_disconnects = &metrics.GetCounter("http_stream_slow_disconnects_total", "Subscribers disconnected for falling behind.");
+    }
+
+    // Учитывает отправленный ответ в метриках его маршрута
+    void ObserveReply(const Reply &reply, bool sent, std::chrono::steady_clock::time_point start) const
+    {
+        const RouteMetrics &route = m_route_metrics[reply.route];
+        route.requests->Add();
+        route.latency->Observe(utillib::SecondsSince(start));
+        if (sent)
+        {
+            m_sent_bytes->Add(GetReplySize(reply));
+        }
+        else
+        {
+            m_send_errors->Add();
+        }
+    }
+
+    std::vector<RouteMetrics> m_route_metrics;
+    utillib::Counter *m_sent_bytes = nullptr;
+    utillib::Counter *m_send_errors = nullptr;
+    utillib::Counter *m_accept_errors = nullptr;
+    utillib::Counter *m_recv_errors = nullptr;
+    utillib::Counter *m_oversized_requests = nullptr;
+    utillib::Gauge *m_stream_subscribers = nullptr;
+    utillib::Counter *m_stream_dropped = nullptr;
+    utillib::Counter *m_stream_slow_disconnects = nullptr;
+
+    std::vector<EventStream *> m_streams; // Зарегистрированные потоки событий
+
+    char m_input_buf[4096]; // Буфер для данных
+    Router m_router; // Зарегистрированные маршруты
     ErrorResponse error_response; // Ответ об ошибке
 };
 
@@ -4,27 +4,60 @@ const log_type = url.searchParams.get("log");
 const h1_map = {
     "all": "Temperature all",
     "hour": "Temperature hour",
-    "day": "Temperature day"
+    "day": "Temperature day",
+    "live": "Temperature live"
 };
 
 if (!h1_map[log_type]) {
     window.location.replace(`${url.origin}/404.http`);
 }
 
-fetch(`/${log_type}`)
-    .then(response => response.ok ? response.text() : Promise.reject(response))
-    .then(data => {
-        const table = document.querySelector(".tab");
-        table.innerHTML = `<tr><th>Time</th><th>Temperature</th></tr>` +
-            data.trim().split("\n").map(line => {
-                const [timestamp, temp] = line.split(" ");
-                const date = new Date(parseInt(timestamp) * 1000).toLocaleString();
-                return `<tr><td>${date}</td><td>${temp}</td></tr>`;
-            }).join("");
-    })
-    .catch(() => {
-        document.querySelector(".tab").innerHTML = "No data gathered yet!";
-    })
-    .finally(() => {
-        document.querySelector("h1").textContent = h1_map[log_type];
+// Живые измерения: новые строки добавляются в начало таблицы по событиям /stream, таблица не перестраивается
+const LIVE_MAX_ROWS = 100;
+
+function showLive() {
+    const table = document.querySelector(".tab");
+    table.innerHTML = `<tr><th>Sensor</th><th>Time</th><th>Temperature</th></tr>`;
+    const header = table.firstElementChild;
+    const source = new EventSource("/stream");
+    source.addEventListener("sample", event => {
+        const [sensor, timestamp, temp] = event.data.split(" ");
+        const row = document.createElement("tr");
+        for (const text of [sensor, new Date(parseInt(timestamp) * 1000).toLocaleString(), temp]) {
+            const cell = document.createElement("td");
+            cell.textContent = text;
+            row.appendChild(cell);
+        }
+        header.after(row);
+        if (table.rows.length > LIVE_MAX_ROWS + 1) {
+            table.lastElementChild.remove();
+        }
     });
+    document.querySelector("h1").textContent = h1_map[log_type];
+}
+
+// Для всех измерений берём прореженный ряд за сутки (5-минутные средние), а не 86400 строк
+const now = Math.floor(Date.now() / 1000);
+const endpoint = log_type === "all" ? `/series?from=${now - 86400}&to=${now + 1}&step=300&agg=mean` : `/${log_type}`;
+
+if (log_type === "live") {
+    showLive();
+} else {
+    fetch(endpoint)
+        .then(response => response.ok ? response.text() : Promise.reject(response))
+        .then(data => {
+            const table = document.querySelector(".tab");
+            table.innerHTML = `<tr><th>Time</th><th>Temperature</th></tr>` +
+                data.trim().split("\n").map(line => {
+                    const [timestamp, temp] = line.split(" ");
+                    const date = new Date(parseInt(timestamp) * 1000).toLocaleString();
+                    return `<tr><td>${date}</td><td>${temp}</td></tr>`;
+                }).join("");
+        })
+        .catch(() => {
+            document.querySelector(".tab").innerHTML = "No data gathered yet!";
+        })
+        .finally(() => {
+            document.querySelector("h1").textContent = h1_map[log_type];
+        });
+}
@@ -0,0 +1,177 @@
+#include "log_parser.hpp"
+
+#include <charconv>
+#include <fstream>
+#include <filesystem>
+
+namespace fs = std::filesystem;
+
+namespace tslib
+{
+    static const double POW10[] = {1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11, 1e12, 1e13, 1e14, 1e15};
+
+    // Быстрый путь для обычной записи "[-]цифры[.цифры]" до 15 цифр: мантисса точно представима в double,
+    // а деление на точную степень 10 округляется так же, как в from_chars. nullptr - нужен общий разбор
+    static const char *ParseSimpleDouble(const char *ptr, const char *end, double &value)
+    {
+        bool negative = ptr != end && *ptr == '-';
+        if (negative) ++ptr;
+
+        uint64_t mantissa = 0;
+        int digits = 0;
+        int fraction = 0;
+        while (ptr != end && (unsigned)(*ptr - '0') < 10)
+        {
+            mantissa = mantissa * 10 + (*ptr++ - '0');
+            ++digits;
+        }
+        if (ptr != end && *ptr == '.')
+        {
+            ++ptr;
+            while (ptr != end && (unsigned)(*ptr - '0') < 10)
+            {
+                mantissa = mantissa * 10 + (*ptr++ - '0');
+                ++digits;
+                ++fraction;
+            }
+        }
+        if (digits == 0 || digits > 15 || (ptr != end && (*ptr == 'e' || *ptr == 'E')))
+        {
+            return nullptr;
+        }
+
+        value = (double)mantissa / POW10[fraction];
+        if (negative) value = -value;
+        return ptr;
+    }
+
+    // Целое до 18 цифр без переполнения; nullptr - нужен общий разбор
+    static const char *ParseSimpleInt(const char *ptr, const char *end, int64_t &value)
+    {
+        bool negative = ptr != end && *ptr == '-';
+        if (negative) ++ptr;
+
+        int64_t result = 0;
+        const char *start = ptr;
+        while (ptr != end && (unsigned)(*ptr - '0') < 10 && ptr - start < 18)
+        {
+            result = result * 10 + (*ptr++ - '0');
+        }
+        if (ptr == start || (ptr != end && (unsigned)(*ptr - '0') < 10)) return nullptr;
+
+        value = negative ? -result : result;
+        return ptr;
+    }
+
+    static const char *ParseNumber(const char *ptr, const char *end, int64_t &value)
+    {
+        const char *next = ParseSimpleInt(ptr, end, value);
+        if (next != nullptr) return next;
+        auto res = std::from_chars(ptr, end, value);
+        return res.ec == std::errc() ? res.ptr : nullptr;
+    }
+
+    static const char *ParseNumber(const char *ptr, const char *end, double &value)
+    {
+        const char *next = ParseSimpleDouble(ptr, end, value);
+        if (next != nullptr) return next;
+        auto res = std::from_chars(ptr, end, value);
+        return res.ec == std::errc() ? res.ptr : nullptr;
+    }
+
+    bool ParseInt(std::string_view str, int64_t &value)
+    {
+        const char *end = str.data() + str.size();
+        return ParseNumber(str.data(), end, value) == end;
+    }
+
+    bool ParseDouble(std::string_view str, double &value)
+    {
+        const char *end = str.data() + str.size();
+        return ParseNumber(str.data(), end, value) == end;
+    }
+
+    bool ParseTemperature(std::string_view str, double &value)
+    {
+        auto is_frame_char = [](char ch) { return ch == '$' || ch == ' ' || (ch >= '\t' && ch <= '\r'); };
+        while (!str.empty() && is_frame_char(str.front())) str.remove_prefix(1);
+        while (!str.empty() && is_frame_char(str.back())) str.remove_suffix(1);
+        // from_chars не принимает ведущий '+'
+        if (!str.empty() && str.front() == '+') str.remove_prefix(1);
+        return !str.empty() && ParseDouble(str, value);
+    }
+
+    bool ParseLogLine(std::string_view line, int64_t &time, double &value)
+    {
+        const char *end = line.data() + line.size();
+        const char *ptr = ParseNumber(line.data(), end, time);
+        if (ptr == nullptr) return false;
+        if (ptr != end && *ptr == '.')
+        {
+            // Дробная часть секунд ("1700000000.012345") отбрасывается с округлением вниз
+            bool nonzero = false;
+            const char *digits = ++ptr;
+            while (ptr != end && (unsigned)(*ptr - '0') < 10) nonzero |= *ptr++ != '0';
+            if (ptr == digits) return false;
+            if (nonzero && line.front() == '-') --time;
+        }
+        if (ptr == end || *ptr != ' ') return false;
+        return ParseNumber(ptr + 1, end, value) != nullptr;
+    }
+
+    void LogColumns::Clear()
+    {
+        times.clear();
+        values.clear();
+        bad_lines = 0;
+    }
+
+    size_t ScanLogBuffer(std::string_view buffer, LogColumns &columns)
+    {
+        const char *begin = buffer.data();
+        const char *end = begin + buffer.size();
+        const char *line = begin;
+        const char *newline;
+        // memchr ищет перевод строки по много байт за шаг
+        while ((newline = (const char *)memchr(line, '\n', end - line)) != nullptr)
+        {
+            int64_t time = 0;
+            double value = 0;
+            if (ParseLogLine(std::string_view(line, newline - line), time, value))
+            {
+                columns.times.push_back(time);
+                columns.values.push_back(value);
+            }
+            else if (newline != line)
+            {
+                ++columns.bad_lines;
+            }
+            line = newline + 1;
+        }
+        return line - begin;
+    }
+
+    bool ScanLogFile(const std::string &file_path, LogColumns &columns, uint64_t offset)
+    {
+        std::error_code ec;
+        uint64_t size = fs::file_size(file_path, ec);
+        if (ec) return false;
+        if (offset >= size) return true;
+
+        std::ifstream file(file_path, std::ios::binary);
+        if (!file) return false;
+        file.seekg((std::streamoff)offset);
+
+        std::string buffer(size - offset, '\0');
+        file.read(buffer.data(), (std::streamsize)buffer.size());
+        buffer.resize((size_t)file.gcount());
+        // Последняя строка без перевода строки тоже учитывается
+        if (!buffer.empty() && buffer.back() != '\n') buffer.push_back('\n');
+
+        // Примерная длина строки "1700000000 -12.345678" - около 20 байт
+        columns.times.reserve(columns.times.size() + buffer.size() / 16);
+        columns.values.reserve(columns.values.size() + buffer.size() / 16);
+        ScanLogBuffer(buffer, columns);
+        return true;
+    }
+}
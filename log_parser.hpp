@@ -0,0 +1,90 @@
+#ifndef LOG_PARSER_HPP
+#define LOG_PARSER_HPP
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <cstdint>
+#include <cstring>
+#include <istream>
+
+namespace tslib
+{
+#define LOG_SCAN_CHUNK_SIZE 65536
+
+    // Число целиком, без пробелов и лишних символов; без исключений и выделений памяти
+    bool ParseInt(std::string_view str, int64_t &value);
+    bool ParseDouble(std::string_view str, double &value);
+
+    // Показание датчика: число, возможно обрамлённое '$' и пробельными символами ("$23.5$\r")
+    bool ParseTemperature(std::string_view str, double &value);
+
+    // Строка лога "время значение"; время в секундах, дробная часть секунд допускается и отбрасывается
+    bool ParseLogLine(std::string_view line, int64_t &time, double &value);
+
+    // Записи лога по столбцам
+    struct LogColumns
+    {
+        std::vector<int64_t> times;
+        std::vector<double> values;
+        size_t bad_lines = 0; // Строки, которые не удалось разобрать
+
+        size_t Size() const { return times.size(); }
+        void Clear();
+    };
+
+    // Разбирает все целые строки буфера в столбцы (дописывая к ним).
+    // Возвращает число разобранных байт - до конца последней строки с '\n'
+    size_t ScanLogBuffer(std::string_view buffer, LogColumns &columns);
+
+    // Читает лог целиком (с позиции offset) одним чтением и разбирает его в столбцы
+    bool ScanLogFile(const std::string &file_path, LogColumns &columns, uint64_t offset = 0);
+
+    // Читает поток лога блоками по LOG_SCAN_CHUNK_SIZE, начиная с позиции offset, и вызывает
+    // func(время, значение, начало_строки, конец_строки) для каждой разобранной строки с '\n';
+    // func возвращает false, чтобы остановиться. Возвращает позицию после последней просмотренной строки
+    template <typename Func>
+    uint64_t ScanLogStream(std::istream &in, uint64_t offset, Func &&func)
+    {
+        in.seekg((std::streamoff)offset);
+        std::vector<char> buffer(LOG_SCAN_CHUNK_SIZE);
+        size_t filled = 0;
+
+        while (in)
+        {
+            if (filled == buffer.size())
+            {
+                buffer.resize(buffer.size() * 2); // Строка длиннее блока
+            }
+            in.read(buffer.data() + filled, (std::streamsize)(buffer.size() - filled));
+            filled += (size_t)in.gcount();
+
+            const char *begin = buffer.data();
+            const char *end = begin + filled;
+            const char *line = begin;
+            const char *newline;
+            while ((newline = (const char *)memchr(line, '\n', end - line)) != nullptr)
+            {
+                int64_t time = 0;
+                double value = 0;
+                uint64_t line_offset = offset + (line - begin);
+                uint64_t line_end = line_offset + (newline - line) + 1;
+                if (ParseLogLine(std::string_view(line, newline - line), time, value) &&
+                    !func(time, value, line_offset, line_end))
+                {
+                    return line_offset;
+                }
+                line = newline + 1;
+            }
+
+            // Недописанную строку переносим в начало буфера
+            size_t consumed = line - begin;
+            offset += consumed;
+            filled -= consumed;
+            memmove(buffer.data(), line, filled);
+        }
+        return offset;
+    }
+}
+
+#endif // LOG_PARSER_HPP
@@ -1,6 +1,14 @@
 #include "http_server.hpp"
 #include "serial_port.hpp"
+#include "sensor_protocol.hpp"
 #include "general_utils.hpp"
+#include "ts_storage.hpp"
+#include "aggregates.hpp"
+#include "segmented_log.hpp"
+#include "time_index.hpp"
+#include "spsc_queue.hpp"
+#include "log_parser.hpp"
+#include "metrics.hpp"
 
 #include <string>
 #include <iostream>
@@ -10,135 +18,533 @@
 #include <vector>
 #include <thread>
 #include <atomic>
+#include <memory>
 
-namespace fs = std::filesystem;
+#ifndef WIN32
+#include <poll.h>
+#endif
 
-struct ParsedData {
-    double temp = 0;
-    bool is_error = false;
-};
+namespace fs = std::filesystem;
 
 constexpr char LOG_DIR[] = "logs";
 constexpr char LOG_ALL_NAME[] = "logs/temperature_log_all.log";
 constexpr char LOG_HOUR_NAME[] = "logs/temperature_log_hourly.log";
 constexpr char LOG_DAY_NAME[] = "logs/temperature_log_daily.log";
-
-
-void CreateFileIfNotExists(const std::string& name) {
-    if (!fs::exists(name)) {
-        std::ofstream(name).close();
-    }
-}
+constexpr char SERIES_ALL_DIR[] = "logs/all";
+constexpr char HOUR_LOG_DIR[] = "logs/hourly";
+constexpr char DAY_LOG_DIR[] = "logs/daily";
+constexpr char AGGREGATES_NAME[] = "logs/aggregates.state";
+constexpr char SENSORS_DIR[] = "logs/sensors";
 
 constexpr int64_t HOUR_SEC = 3600;
 constexpr int64_t DAY_SEC = HOUR_SEC * 24;
 constexpr int64_t MONTH_SEC = DAY_SEC * 30;
 constexpr int64_t YEAR_SEC = DAY_SEC * 365;
 
-double GetMeanTemp(const std::string& file_name, int64_t now, int64_t diff_sec) {
-    std::ifstream log(file_name);
-    if (!log.is_open()) return 0.0;
+// Датчик: порт и его хранилища. Все измерения в бинарном хранилище (сегмент на час, хранится сутки),
+// средние за час (сегмент на сутки, хранятся месяц) и за сутки (сегмент на месяц, хранятся год).
+// Первый датчик пишет в прежние пути logs/..., остальные - в logs/sensors/<id>/...
+struct Sensor {
+    std::string id;
+    std::string port_name;
+    splib::SerialPort port;
+    splib::SensorStream stream; // Формат (текст или двоичные пакеты) определяется по первым данным
+    tslib::Series raw_series;
+    tslib::SegmentedLog hour_log;
+    tslib::SegmentedLog day_log;
+    std::string aggregates_name;
+    tslib::AggregateSet aggregates;
+    uint64_t unsaved = 0;
+    int64_t next_open = 0; // Когда снова пытаться открыть порт
+    int64_t last_time = 0; // Время последнего измерения, поставленного в очередь
+    // Измерения двоичных пакетов текущей секунды: хранилище секундное, и вместо одинаковых меток
+    // в очередь уходит их среднее (AddPacketSample); пишет только поток чтения портов
+    int64_t pending_time = 0;
+    double pending_sum = 0;
+    uint64_t pending_count = 0;
+    // Счётчики потока для /ingest; пишет только поток чтения портов
+    std::atomic<uint64_t> packets{0};
+    std::atomic<uint64_t> bad_frames{0};
+    std::atomic<uint64_t> lost_packets{0};
+    std::atomic<uint64_t> lost_samples{0};
+    // Метрики датчика для /metrics (RegisterSensorMetrics)
+    utillib::Counter* received_bytes = nullptr;
+    utillib::Counter* samples = nullptr;
+    utillib::Counter* parse_errors = nullptr;
+    uint64_t reported_bytes = 0; // Байты порта, уже учтённые в received_bytes
+};
+
+// Заполняется до запуска потоков и дальше не меняется
+std::vector<std::unique_ptr<Sensor>> sensors;
+
+// Разобранное измерение на пути от потока чтения портов к потоку записи
+struct Sample {
+    Sensor* sensor = nullptr;
+    int64_t time = 0;
+    double value = 0;
+};
 
-    double mean = 0;
-    uint32_t count = 0;
-    std::string line;
-    while (std::getline(log, line)) {
-        auto split = utillib::Split(line, " ");
-        if (split.size() < 2) continue;
+constexpr size_t SAMPLE_QUEUE_CAPACITY = 65536;
+// Запись на диск и агрегаты не задерживают чтение портов: при переполнении измерения отбрасываются
+utillib::SpscQueue<Sample> sample_queue(SAMPLE_QUEUE_CAPACITY);
 
-        int64_t time = std::stoll(split[0]);
-        if (now - time >= diff_sec) break;
+// Измерения для GET /stream: каждое кодируется один раз и рассылается всем подписчикам
+srvlib::EventStream sample_stream;
 
-        mean += std::stod(split[1]);
-        ++count;
+constexpr char DEFAULT_SERIAL_PORT_NAME[] = "COM4";
+constexpr char DEFAULT_SERVER_HOST[] = "127.0.0.1";
+constexpr short DEFAULT_SERVER_PORT = 8080;
+constexpr char MIME_TYPES_FILE[] = "mime.types";
+
+constexpr char HOUR_WINDOW[] = "hour";
+constexpr char DAY_WINDOW[] = "day";
+constexpr uint64_t AGGREGATES_SAVE_EVERY = 60; // Сохранять окна каждые N измерений
+constexpr int INGEST_POLL_MS = 1000;
+constexpr int64_t PORT_REOPEN_SEC = 5;
+
+// Метрики потока записи
+utillib::Counter& stored_samples = utillib::Metrics().GetCounter("storage_samples_total", "Samples written to storage.");
+utillib::Histogram& hour_rollup_duration = utillib::Metrics().GetHistogram(
+    "rollup_duration_seconds", "Time to close an aggregation window.", utillib::MetricLabel("window", HOUR_WINDOW));
+utillib::Histogram& day_rollup_duration = utillib::Metrics().GetHistogram(
+    "rollup_duration_seconds", "Time to close an aggregation window.", utillib::MetricLabel("window", DAY_WINDOW));
+utillib::Histogram& aggregates_save_duration = utillib::Metrics().GetHistogram(
+    "aggregates_save_duration_seconds", "Time to save aggregation windows.");
+
+// Список датчиков "id порт": "@файл" со строкой на датчик (# - комментарий) или порты через запятую.
+// Если id не задан, им становится имя порта без каталога
+std::vector<std::pair<std::string, std::string>> ParseSensorList(const std::string& arg) {
+    std::vector<std::pair<std::string, std::string>> list;
+    auto add = [&list](std::string id, const std::string& port) {
+        if (port.empty()) return;
+        if (id.empty()) id = fs::path(port).filename().string();
+        for (const auto& item : list) {
+            if (item.first == id) id += "_" + std::to_string(list.size());
+        }
+        list.emplace_back(id, port);
+    };
+
+    if (!arg.empty() && arg[0] == '@') {
+        std::ifstream file(arg.substr(1));
+        std::string line;
+        while (std::getline(file, line)) {
+            std::istringstream words(line);
+            std::string first, second;
+            if (!(words >> first) || first[0] == '#') continue;
+            if (words >> second) {
+                add(first, second);
+            } else {
+                add("", first);
+            }
+        }
+    } else {
+        for (const auto& port : utillib::Split(arg, ",")) {
+            add("", utillib::Trim(port));
+        }
     }
-    return count > 0 ? mean / count : 0.0;
+    return list;
 }
 
-void WriteTempToFile(const std::string& file_name, double temp, int64_t now, int64_t lim_sec) {
-    std::string temp_name = LOG_DIR + std::string("/temp.log");
-    fs::rename(file_name, temp_name);
+// Открывает хранилища датчика; первый датчик при пустых хранилищах импортирует прежние текстовые логи
+bool OpenSensorStorage(Sensor& sensor, bool legacy) {
+    std::string dir = std::string(SENSORS_DIR) + "/" + sensor.id;
+    std::string all_dir = legacy ? SERIES_ALL_DIR : dir + "/all";
+    std::string hour_dir = legacy ? HOUR_LOG_DIR : dir + "/hourly";
+    std::string day_dir = legacy ? DAY_LOG_DIR : dir + "/daily";
+    sensor.aggregates_name = legacy ? AGGREGATES_NAME : dir + "/aggregates.state";
+
+    if (!sensor.raw_series.Open(all_dir, HOUR_SEC)) {
+        std::cerr << "Failed to open storage: " << all_dir << std::endl;
+        return false;
+    }
+    if (!sensor.hour_log.Open(hour_dir, DAY_SEC, MONTH_SEC) || !sensor.day_log.Open(day_dir, MONTH_SEC, YEAR_SEC)) {
+        std::cerr << "Failed to open rollup logs for sensor: " << sensor.id << std::endl;
+        return false;
+    }
 
-    std::ofstream of_log(file_name);
-    std::ifstream temp_log(temp_name);
-    if (!of_log.is_open() || !temp_log.is_open()) return;
+    if (legacy) {
+        // Перенос текстовых логов в хранилища при первом запуске
+        if (sensor.raw_series.Empty() && fs::exists(LOG_ALL_NAME)) {
+            std::cout << "Imported records: " << sensor.raw_series.ImportText(LOG_ALL_NAME) << std::endl;
+        }
+        if (sensor.hour_log.Empty() && fs::exists(LOG_HOUR_NAME)) {
+            std::cout << "Imported hourly records: " << sensor.hour_log.ImportText(LOG_HOUR_NAME) << std::endl;
+        }
+        if (sensor.day_log.Empty() && fs::exists(LOG_DAY_NAME)) {
+            std::cout << "Imported daily records: " << sensor.day_log.ImportText(LOG_DAY_NAME) << std::endl;
+        }
+    }
 
-    std::string line;
-    while (std::getline(temp_log, line)) {
-        auto split = utillib::Split(line, " ");
-        if (split.size() < 2) continue;
+    // Окна часа и суток пополняются на каждом измерении, итоги за окно - O(1)
+    if (!tslib::LoadAggregates(sensor.aggregates_name, sensor.aggregates)) {
+        sensor.aggregates[HOUR_WINDOW].Reset(utillib::GetUNIXTimeNow());
+        sensor.aggregates[DAY_WINDOW].Reset(utillib::GetUNIXTimeNow());
+    }
+    return true;
+}
 
-        int64_t time = std::stoll(split[0]);
-        if (now - time < lim_sec) {
-            of_log << line << '\n';
-        }
+bool OpenSensorPort(Sensor& sensor) {
+    if (sensor.port.Open(sensor.port_name, splib::SerialPort::Parameters(splib::SerialPort::BAUDRATE_115200)) != splib::SerialPort::RE_OK ||
+        sensor.port.SetNonBlocking(true) != splib::SerialPort::RE_OK) {
+        sensor.port.Close();
+        std::cerr << "Failed to open port: " << sensor.port_name << std::endl;
+        return false;
     }
-    of_log << now << " " << temp << std::endl;
+    sensor.stream.Reset();
+    std::cout << "Sensor " << sensor.id << " on port: " << sensor.port_name << std::endl;
+    return true;
+}
 
-    fs::remove(temp_name);
+// Закрывает отвалившийся порт; переоткрытие - не раньше чем через PORT_REOPEN_SEC
+void CloseSensorPort(Sensor& sensor, const char* reason) {
+    std::cerr << reason << ": " << sensor.port_name << std::endl;
+    sensor.port.Close();
+    sensor.next_open = utillib::GetUNIXTimeNow() + PORT_REOPEN_SEC;
 }
 
-ParsedData ParseTemperature(const std::string& str) {
-    auto comp_dollar = [](int ch) -> int { return (std::isspace(ch) || ch == '$') ? 1 : 0; };
-    auto str_temp = utillib::Trim(str, comp_dollar);
+// Учитывает измерение датчика: хранилище сырых данных и окна часа/суток
+void ProcessSample(Sensor& sensor, int64_t now_time, double temp) {
+    auto& hour_agg = sensor.aggregates[HOUR_WINDOW];
+    auto& day_agg = sensor.aggregates[DAY_WINDOW];
+    sensor.raw_series.Append(now_time, temp);
 
-    try {
-        return {std::stod(str_temp), false};
-    } catch (...) {
-        return {0, true};
+    stored_samples.Add();
+
+    bool rolled = false;
+    if (now_time - hour_agg.start >= HOUR_SEC) {
+        auto start = std::chrono::steady_clock::now();
+        if (!hour_agg.Empty()) {
+            sensor.hour_log.Append(now_time, hour_agg.Mean());
+        }
+        sensor.raw_series.DropBefore(now_time - DAY_SEC);
+        hour_agg.Reset(now_time);
+        rolled = true;
+        hour_rollup_duration.Observe(utillib::SecondsSince(start));
     }
-}
 
+    if (now_time - day_agg.start >= DAY_SEC) {
+        auto start = std::chrono::steady_clock::now();
+        if (!day_agg.Empty()) {
+            sensor.day_log.Append(now_time, day_agg.Mean());
+        }
+        day_agg.Reset(now_time);
+        rolled = true;
+        day_rollup_duration.Observe(utillib::SecondsSince(start));
+    }
 
-constexpr char DEFAULT_SERIAL_PORT_NAME[] = "COM4";
-constexpr char DEFAULT_SERVER_HOST[] = "127.0.0.1";
-constexpr short DEFAULT_SERVER_PORT = 8080;
+    hour_agg.Add(temp);
+    day_agg.Add(temp);
 
-std::atomic<int64_t> last_hour_gather(0);
-std::atomic<int64_t> last_day_gather(0);
+    if (rolled || ++sensor.unsaved >= AGGREGATES_SAVE_EVERY) {
+        auto start = std::chrono::steady_clock::now();
+        tslib::SaveAggregates(sensor.aggregates_name, sensor.aggregates);
+        sensor.unsaved = 0;
+        aggregates_save_duration.Observe(utillib::SecondsSince(start));
+    }
+}
 
-void SerialThread(const std::string& serial_port_name) {
-    splib::SerialPort serial_port(serial_port_name, splib::SerialPort::BAUDRATE_115200);
+// Ставит измерение в очередь; время не убывает, иначе хранилище его отвергнет
+void PushSample(Sensor& sensor, int64_t time, double value, uint64_t parsed = 1) {
+    sensor.last_time = std::max(sensor.last_time, time);
+    sensor.samples->Add(parsed);
+    sample_queue.Push({&sensor, sensor.last_time, value});
+}
 
-    if (!serial_port.IsOpen()) {
-        std::cerr << "Failed to open port: " << serial_port_name << std::endl;
-        return;
+// Ставит в очередь среднее накопленных измерений пакетов, если их секунда закончилась (или всегда при force)
+void FlushPacketSamples(Sensor& sensor, int64_t now, bool force = false) {
+    if (sensor.pending_count == 0 || (!force && sensor.pending_time >= now)) return;
+    PushSample(sensor, sensor.pending_time, sensor.pending_sum / sensor.pending_count, sensor.pending_count);
+    sensor.pending_count = 0;
+    sensor.pending_sum = 0;
+}
+
+// Измерение пакета с меткой в мс: измерения одной секунды складываются, в очередь - одно на секунду.
+// Метки восстанавливаются от момента приёма, и начало пакета может попасть в уже отправленную секунду:
+// такое измерение добавляется к следующей, чтобы метки в очереди не повторялись
+void AddPacketSample(Sensor& sensor, int64_t time_ms, double value) {
+    int64_t time = std::max(time_ms / 1000, sensor.last_time + 1);
+    if (sensor.pending_count > 0 && time != sensor.pending_time) {
+        FlushPacketSamples(sensor, time, true);
     }
+    sensor.pending_time = time;
+    sensor.pending_sum += value;
+    ++sensor.pending_count;
+}
 
-    fs::create_directories(LOG_DIR);
-    CreateFileIfNotExists(LOG_ALL_NAME);
-    CreateFileIfNotExists(LOG_HOUR_NAME);
-    CreateFileIfNotExists(LOG_DAY_NAME);
+// Читает всё, что пришло с порта датчика, и ставит измерения в очередь; false - порт закрыт из-за ошибки
+bool ReadSensor(Sensor& sensor, std::vector<std::string>& frames) {
+    // Все целые кадры, пришедшие за одно чтение; обрывок кадра ждёт следующего
+    frames.clear();
+    if (sensor.stream.ReadFrames(sensor.port, frames) != splib::SerialPort::RE_OK) {
+        CloseSensorPort(sensor, "Failed to read port");
+        return false;
+    }
+    uint64_t received = sensor.port.GetReceivedBytes();
+    sensor.received_bytes->Add(received - sensor.reported_bytes);
+    sensor.reported_bytes = received;
+
+    if (sensor.stream.GetFormat() == splib::SensorStream::FORMAT_TEXT) {
+        for (const auto& frame : frames) {
+            double temp = 0;
+            if (tslib::ParseTemperature(frame, temp)) {
+                PushSample(sensor, utillib::GetUNIXTimeNow(), temp);
+            } else {
+                sensor.parse_errors->Add();
+            }
+        }
+        return true;
+    }
 
-    last_hour_gather = utillib::GetUNIXTimeNow();
-    last_day_gather = utillib::GetUNIXTimeNow();
+    // Измерения пакета идут с шагом interval_ms и заканчиваются моментом приёма
+    splib::SensorPacket packet;
+    for (const auto& frame : frames) {
+        if (!sensor.stream.ParsePacket(frame, packet)) continue;
+        int64_t now_ms = std::chrono::duration_cast<std::chrono::milliseconds>(
+            std::chrono::system_clock::now().time_since_epoch()).count();
+        int64_t count = (int64_t)packet.values.size();
+        for (int64_t i = 0; i < count; ++i) {
+            AddPacketSample(sensor, now_ms - (count - 1 - i) * packet.interval_ms, packet.values[i]);
+        }
+    }
+    sensor.packets = sensor.stream.GetPackets();
+    sensor.bad_frames = sensor.stream.GetBadFrames();
+    sensor.lost_packets = sensor.stream.GetLostPackets();
+    sensor.lost_samples = sensor.stream.GetLostSamples();
+    return true;
+}
 
-    std::string input;
-    serial_port.SetTimeout(1.0);
+// Один поток на все порты: неблокирующие дескрипторы в poll, чтение только готовых.
+// Порт, отвалившийся с ошибкой, переоткрывается не чаще раза в PORT_REOPEN_SEC
+void IngestThread() {
+    std::vector<std::string> frames;
+#ifdef WIN32
+    // Для COM-портов poll нет: опрашиваем по кругу неблокирующим чтением
+    while (true) {
+        int64_t now = utillib::GetUNIXTimeNow();
+        bool got_data = false;
+        for (auto& sensor : sensors) {
+            FlushPacketSamples(*sensor, now);
+            if (!sensor->port.IsOpen() && (now < sensor->next_open || !OpenSensorPort(*sensor))) {
+                sensor->next_open = std::max(sensor->next_open, now + PORT_REOPEN_SEC);
+                continue;
+            }
+            if (ReadSensor(*sensor, frames) && !frames.empty()) {
+                got_data = true;
+            }
+        }
+        if (!got_data) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(INGEST_POLL_MS / 20));
+        }
+    }
+#else
+    std::vector<pollfd> fds;
+    std::vector<Sensor*> polled;
+    bool changed = true;
 
     while (true) {
-        serial_port >> input;
-        auto parsed = ParseTemperature(input);
-        if (parsed.is_error) continue;
+        int64_t now = utillib::GetUNIXTimeNow();
+        for (auto& sensor : sensors) {
+            // Последняя секунда пакетов уходит в очередь, когда закончится; poll просыпается не реже INGEST_POLL_MS
+            FlushPacketSamples(*sensor, now);
+            if (!sensor->port.IsOpen() && now >= sensor->next_open) {
+                if (OpenSensorPort(*sensor)) {
+                    changed = true;
+                } else {
+                    sensor->next_open = now + PORT_REOPEN_SEC;
+                }
+            }
+        }
 
-        int64_t now_time = utillib::GetUNIXTimeNow();
-        
+        if (changed) {
+            fds.clear();
+            polled.clear();
+            for (auto& sensor : sensors) {
+                if (sensor->port.IsOpen()) {
+                    fds.push_back({sensor->port.GetHandle(), POLLIN, 0});
+                    polled.push_back(sensor.get());
+                }
+            }
+            changed = false;
+        }
 
-        if (now_time - last_hour_gather >= HOUR_SEC) {
-            double hour_mean = GetMeanTemp(LOG_ALL_NAME, now_time, HOUR_SEC);
-            WriteTempToFile(LOG_HOUR_NAME, hour_mean, now_time, MONTH_SEC);
-            last_hour_gather = now_time;
+        int ready = poll(fds.data(), fds.size(), INGEST_POLL_MS);
+        if (ready <= 0) continue;
+
+        for (size_t i = 0; i < fds.size(); ++i) {
+            short revents = fds[i].revents;
+            if (revents == 0) continue;
+            Sensor& sensor = *polled[i];
+            uint64_t received = sensor.port.GetReceivedBytes();
+            uint64_t bad_frames = sensor.stream.GetBadFrames();
+            if (!ReadSensor(sensor, frames)) {
+                changed = true;
+                continue;
+            }
+            // Отключённое устройство: poll сообщает о разрыве или готовность без данных (конец потока).
+            // Иначе poll возвращается сразу и поток крутится вхолостую
+            bool eof = (revents & POLLIN) && frames.empty() && sensor.port.GetReceivedBytes() == received &&
+                       sensor.stream.GetBadFrames() == bad_frames;
+            if ((revents & (POLLHUP | POLLERR | POLLNVAL)) || eof) {
+                CloseSensorPort(sensor, "Port disconnected");
+                changed = true;
+            }
         }
+    }
+#endif
+}
 
-        if (now_time - last_day_gather >= DAY_SEC) {
-            double day_mean = GetMeanTemp(LOG_HOUR_NAME, now_time, DAY_SEC);
-            WriteTempToFile(LOG_DAY_NAME, day_mean, now_time, YEAR_SEC);
-            last_day_gather = now_time;
+// Единственный читатель очереди: хранилища, окна часа/суток, сохранение агрегатов и поток событий
+void StorageThread() {
+    Sample sample;
+    std::string data;
+    while (true) {
+        sample_queue.Wait();
+        while (sample_queue.Pop(sample)) {
+            ProcessSample(*sample.sensor, sample.time, sample.value);
+
+            // Событие "sample": "id_датчика время значение"
+            data = sample.sensor->id + " ";
+            tslib::AppendTextRecord(data, sample.time, sample.value);
+            data.pop_back();
+            sample_stream.Publish("sample", data);
         }
     }
 }
 
-void ServerThread(const std::string& host_ip, short port) {
+Sensor* FindSensor(const std::string& id) {
+    if (id.empty()) return sensors.front().get();
+    for (auto& sensor : sensors) {
+        if (sensor->id == id) return sensor.get();
+    }
+    return nullptr;
+}
+
+constexpr int64_t SERIES_MAX_BUCKETS = 10000;
+
+int64_t GetIntArg(const srvlib::Request& request, const std::string& key, int64_t def) {
+    int64_t value = 0;
+    return tslib::ParseInt(request.GetArg(key), value) ? value : def;
+}
+
+// GET /series?from=&to=&step=&agg=mean|min|max|last&source=all|hour|day&sensor=<id> (или /sensors/<id>/series?...)
+// Прореженные измерения (или средние из логов hour/day) за [from, to): строка "начало_интервала значение" на непустой интервал
+void GetSeries(const srvlib::Request& request, srvlib::ResponseWriter& writer) {
+    Sensor* sensor = FindSensor(request.GetParam("id", request.GetArg("sensor")));
+    if (sensor == nullptr) {
+        writer.SetResponseType("404 Not Found");
+        return;
+    }
+
+    // Границы приходят от клиента: ограничиваем их [0, now + DAY_SEC], а шаг - длиной интервала,
+    // чтобы арифметика над ними не переполнялась
+    int64_t now = utillib::GetUNIXTimeNow();
+    int64_t to = std::clamp<int64_t>(GetIntArg(request, "to", now + 1), 0, now + DAY_SEC);
+    int64_t from = std::clamp<int64_t>(GetIntArg(request, "from", to - DAY_SEC), 0, now + DAY_SEC);
+    if (from >= to) return;
+    int64_t step = std::clamp<int64_t>(GetIntArg(request, "step", 1), 1, to - from);
+    // Ограничиваем размер ответа, укрупняя интервал
+    step = std::max(step, (to - from + SERIES_MAX_BUCKETS - 1) / SERIES_MAX_BUCKETS);
+
+    std::string agg = request.GetArg("agg", "mean");
+    std::string source = request.GetArg("source", "all");
+    std::vector<tslib::Bucket> buckets;
+    if (source == "hour" || source == "day") {
+        tslib::Downsampler downsampler(from, step);
+        (source == "hour" ? sensor->hour_log : sensor->day_log).Query(from, to, [&downsampler](int64_t time, double value) {
+            downsampler.Add(time, value);
+        });
+        buckets = std::move(downsampler.buckets);
+    } else {
+        buckets = sensor->raw_series.Downsample(from, to, step);
+    }
+
+    std::string body;
+    for (const auto& bucket : buckets) {
+        double value = agg == "min" ? bucket.agg.min :
+                       agg == "max" ? bucket.agg.max :
+                       agg == "last" ? bucket.last : bucket.agg.Mean();
+        tslib::AppendTextRecord(body, bucket.start, value);
+    }
+    writer.Write(body);
+}
+
+// GET /all - все сырые измерения первого датчика по сегментам ряда. Все сегменты, кроме последнего,
+// запечатаны, поэтому их сжатое представление сервер строит один раз и берёт из кэша
+void GetAll(const srvlib::Request&, srvlib::ResponseWriter& writer) {
+    const auto& series = sensors.front()->raw_series;
+    auto starts = series.GetSegmentStarts();
+    std::vector<srvlib::BodyPart> parts;
+    for (size_t i = 0; i < starts.size(); ++i) {
+        int64_t from = starts[i];
+        int64_t to = from + series.GetSpan();
+        std::string key = i + 1 < starts.size() ? series.GetDir() + "/" + std::to_string(from) : "";
+        parts.push_back({key, [&series, from, to]() { return series.ExportText(from, to); }});
+    }
+    writer.SendParts(std::move(parts));
+}
+
+// GET /sensors - id датчиков по строке, первый - датчик по умолчанию
+void GetSensorList(const srvlib::Request&, srvlib::ResponseWriter& writer) {
+    for (const auto& sensor : sensors) {
+        writer.Write(sensor->id + "\n");
+    }
+}
+
+// GET /ingest - состояние очереди измерений (занятость, максимум, ёмкость, число отброшенных) и потоков датчиков
+void GetIngestStats(const srvlib::Request&, srvlib::ResponseWriter& writer) {
+    std::string body;
+    body += "queue_size " + std::to_string(sample_queue.Size()) + "\n";
+    body += "queue_max_size " + std::to_string(sample_queue.GetMaxSize()) + "\n";
+    body += "queue_capacity " + std::to_string(sample_queue.Capacity()) + "\n";
+    body += "queue_overflows " + std::to_string(sample_queue.GetOverflows()) + "\n";
+    // Двоичные пакеты по датчикам: принятые, испорченные (COBS/CRC) и пропущенные по номерам
+    for (const auto& sensor : sensors) {
+        std::string prefix = "sensor." + sensor->id + ".";
+        body += prefix + "packets " + std::to_string(sensor->packets) + "\n";
+        body += prefix + "bad_frames " + std::to_string(sensor->bad_frames) + "\n";
+        body += prefix + "lost_packets " + std::to_string(sensor->lost_packets) + "\n";
+        body += prefix + "lost_samples " + std::to_string(sensor->lost_samples) + "\n";
+    }
+    writer.Write(body);
+}
+
+// Метрики датчика: счётчики потока чтения и уже посчитанные SensorStream значения
+void RegisterSensorMetrics(Sensor& sensor) {
+    auto& metrics = utillib::Metrics();
+    std::string labels = utillib::MetricLabel("sensor", sensor.id);
+    sensor.received_bytes = &metrics.GetCounter("serial_received_bytes_total", "Bytes read from the sensor port.", labels);
+    sensor.samples = &metrics.GetCounter("sensor_samples_total", "Samples parsed and queued for storage.", labels);
+    sensor.parse_errors = &metrics.GetCounter("sensor_parse_errors_total", "Text frames rejected by ParseTemperature.", labels);
+    Sensor* ptr = &sensor;
+    metrics.AddCallback("sensor_packets_total", "Binary packets received.", "counter", labels,
+                        [ptr]() { return (double)ptr->packets.load(); });
+    metrics.AddCallback("sensor_bad_frames_total", "Binary frames rejected by COBS or CRC checks.", "counter", labels,
+                        [ptr]() { return (double)ptr->bad_frames.load(); });
+    metrics.AddCallback("sensor_lost_packets_total", "Binary packets missing by sequence number.", "counter", labels,
+                        [ptr]() { return (double)ptr->lost_packets.load(); });
+    metrics.AddCallback("sensor_lost_samples_total", "Estimated samples in missing packets.", "counter", labels,
+                        [ptr]() { return (double)ptr->lost_samples.load(); });
+}
+
+// Занятость очереди измерений (то же, что в /ingest)
+void RegisterQueueMetrics() {
+    auto& metrics = utillib::Metrics();
+    metrics.AddCallback("sample_queue_size", "Samples waiting for the storage thread.", "gauge", "",
+                        []() { return (double)sample_queue.Size(); });
+    metrics.AddCallback("sample_queue_max_size", "Largest queue size seen by the storage thread.", "gauge", "",
+                        []() { return (double)sample_queue.GetMaxSize(); });
+    metrics.AddCallback("sample_queue_capacity", "Sample queue capacity.", "gauge", "",
+                        []() { return (double)sample_queue.Capacity(); });
+    metrics.AddCallback("sample_queue_overflows_total", "Samples dropped because the queue was full.", "counter", "",
+                        []() { return (double)sample_queue.GetOverflows(); });
+}
+
+// GET /metrics - все метрики процесса в текстовом формате Prometheus
+void GetMetrics(const srvlib::Request&, srvlib::ResponseWriter& writer) {
+    writer.Write(utillib::Metrics().Render());
+}
+
+void ServerThread(const std::string& host_ip, short port, size_t worker_count) {
     srvlib::HTTPServer server(host_ip, port);
     if (!server.IsValid()) {
         std::cerr << "Failed to start server at: http://" << host_ip << ":" << port << std::endl;
@@ -147,32 +553,61 @@ void ServerThread(const std::string& host_ip, short port) {
 
     std::cout << "Server started! Open in your browser: http://" << host_ip << ":" << port << "/" << std::endl;
 
-    std::vector<srvlib::SpecialResponse> resps = {
-        {"GET", "/all", []() { return utillib::ReadFile(LOG_ALL_NAME); }},
-        {"GET", "/hour", []() { return utillib::ReadFile(LOG_HOUR_NAME); }},
-        {"GET", "/day", []() { return utillib::ReadFile(LOG_DAY_NAME); }}
-    };
-    server.RegisterResponses(resps);
-
-    while (server.IsValid()) {
-        server.ProcessClient();
+    if (fs::exists(MIME_TYPES_FILE)) {
+        std::cout << "Loaded MIME types: " << srvlib::LoadMimeTypes(MIME_TYPES_FILE) << std::endl;
     }
+
+    server.RegisterRoute("GET", "/all", GetAll);
+    server.RegisterRoute("GET", "/hour", [](const srvlib::Request&, srvlib::ResponseWriter& writer) {
+        writer.SendFiles(sensors.front()->hour_log.GetSegmentFiles(), true);
+    });
+    server.RegisterRoute("GET", "/day", [](const srvlib::Request&, srvlib::ResponseWriter& writer) {
+        writer.SendFiles(sensors.front()->day_log.GetSegmentFiles(), true);
+    });
+    server.RegisterRoute("GET", "/series", GetSeries);
+    server.RegisterRoute("GET", "/sensors", GetSensorList);
+    server.RegisterRoute("GET", "/sensors/:id/series", GetSeries);
+    server.RegisterRoute("GET", "/ingest", GetIngestStats);
+    server.RegisterRoute("GET", "/metrics", GetMetrics);
+    server.RegisterStream("/stream", sample_stream);
+    server.LoadStaticCache();
+
+    server.Run(worker_count);
 }
 
 
 int main(int argc, char** argv) {
-    std::string serial_port_name = (argc > 1) ? argv[1] : DEFAULT_SERIAL_PORT_NAME;
+    std::string sensor_arg = (argc > 1) ? argv[1] : DEFAULT_SERIAL_PORT_NAME;
     std::string host_ip = (argc > 2) ? argv[2] : DEFAULT_SERVER_HOST;
     short server_port = (argc > 3) ? std::stoi(argv[3]) : DEFAULT_SERVER_PORT;
+    size_t worker_count = (argc > 4) ? std::stoul(argv[4]) : DEFAULT_WORKER_COUNT;
 
     std::cout << "Starting server at: http://" << host_ip << ":" << server_port << "/" << std::endl;
 
-    std::thread serial_thread(SerialThread, serial_port_name);
-    std::thread server_thread(ServerThread, host_ip, server_port);
+    fs::create_directories(LOG_DIR);
+    for (const auto& [id, port_name] : ParseSensorList(sensor_arg)) {
+        auto sensor = std::make_unique<Sensor>();
+        sensor->id = id;
+        sensor->port_name = port_name;
+        if (OpenSensorStorage(*sensor, sensors.empty())) {
+            RegisterSensorMetrics(*sensor);
+            sensors.push_back(std::move(sensor));
+        }
+    }
+    if (sensors.empty()) {
+        std::cerr << "No sensors configured: " << sensor_arg << std::endl;
+        return 1;
+    }
+
+    RegisterQueueMetrics();
+
+    std::thread storage_thread(StorageThread);
+    std::thread ingest_thread(IngestThread);
+    std::thread server_thread(ServerThread, host_ip, server_port, worker_count);
 
-    serial_thread.join();
+    ingest_thread.join();
+    storage_thread.join();
     server_thread.join();
 
     return 0;
 }
-
@@ -0,0 +1,336 @@
+#ifndef METRICS_HPP
+#define METRICS_HPP
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace utillib
+{
+#define METRICS_SHARDS 16
+#define METRICS_CACHE_LINE 64
+#define METRICS_SLOTS_PER_LINE (METRICS_CACHE_LINE / sizeof(std::atomic<uint64_t>))
+
+    // Номер шарда потока: раздаётся по кругу при первом обращении потока к метрикам,
+    // так что рабочие потоки пишут в разные строки кэша
+    inline size_t MetricsShard()
+    {
+        static std::atomic<size_t> next_shard{0};
+        thread_local size_t shard = next_shard.fetch_add(1, std::memory_order_relaxed) % METRICS_SHARDS;
+        return shard;
+    }
+
+    // Секунды от start до текущего момента
+    inline double SecondsSince(std::chrono::steady_clock::time_point start)
+    {
+        return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    // Счётчик без блокировок: каждый поток увеличивает свой шард, значение - сумма шардов
+    class Counter
+    {
+    public:
+        void Add(uint64_t value = 1)
+        {
+            m_shards[MetricsShard()].value.fetch_add(value, std::memory_order_relaxed);
+        }
+
+        uint64_t Value() const
+        {
+            uint64_t sum = 0;
+            for (const auto &shard : m_shards)
+            {
+                sum += shard.value.load(std::memory_order_relaxed);
+            }
+            return sum;
+        }
+
+    private:
+        struct alignas(METRICS_CACHE_LINE) Shard
+        {
+            std::atomic<uint64_t> value{0};
+        };
+        Shard m_shards[METRICS_SHARDS];
+    };
+
+    // Текущее значение (число соединений и т.п.); меняется редко, поэтому без шардов
+    class Gauge
+    {
+    public:
+        void Add(int64_t value) { m_value.fetch_add(value, std::memory_order_relaxed); }
+        void Set(int64_t value) { m_value.store(value, std::memory_order_relaxed); }
+        int64_t Value() const { return m_value.load(std::memory_order_relaxed); }
+
+    private:
+        std::atomic<int64_t> m_value{0};
+    };
+
+    // Гистограмма с фиксированными верхними границами корзин (по возрастанию) и корзиной +Inf.
+    // Корзины хранятся по шардам потоков без накопления; накопленные суммы считаются при выводе
+    class Histogram
+    {
+    public:
+        explicit Histogram(const std::vector<double> &bounds)
+            : m_bounds(bounds),
+              m_lines_per_shard((bounds.size() + 1 + METRICS_SLOTS_PER_LINE - 1) / METRICS_SLOTS_PER_LINE),
+              m_lines(m_lines_per_shard * METRICS_SHARDS)
+        {
+        }
+
+        void Observe(double value)
+        {
+            size_t bucket = 0;
+            while (bucket < m_bounds.size() && value > m_bounds[bucket])
+            {
+                ++bucket;
+            }
+            size_t shard = MetricsShard();
+            Slot(shard, bucket).fetch_add(1, std::memory_order_relaxed);
+
+            // Шард пишет в основном один поток, так что цикл почти всегда проходит с первого раза
+            auto &sum = m_sums[shard].value;
+            double old_sum = sum.load(std::memory_order_relaxed);
+            while (!sum.compare_exchange_weak(old_sum, old_sum + value, std::memory_order_relaxed))
+            {
+            }
+        }
+
+        const std::vector<double> &GetBounds() const { return m_bounds; }
+
+        // Число наблюдений по корзинам (последняя - +Inf), без накопления
+        std::vector<uint64_t> GetBuckets() const
+        {
+            std::vector<uint64_t> buckets(m_bounds.size() + 1, 0);
+            for (size_t shard = 0; shard < METRICS_SHARDS; ++shard)
+            {
+                for (size_t bucket = 0; bucket < buckets.size(); ++bucket)
+                {
+                    buckets[bucket] += Slot(shard, bucket).load(std::memory_order_relaxed);
+                }
+            }
+            return buckets;
+        }
+
+        double GetSum() const
+        {
+            double sum = 0;
+            for (const auto &shard : m_sums)
+            {
+                sum += shard.value.load(std::memory_order_relaxed);
+            }
+            return sum;
+        }
+
+    private:
+        struct alignas(METRICS_CACHE_LINE) Line
+        {
+            std::atomic<uint64_t> slots[METRICS_SLOTS_PER_LINE] = {};
+        };
+        struct alignas(METRICS_CACHE_LINE) SumShard
+        {
+            std::atomic<double> value{0};
+        };
+
+        std::atomic<uint64_t> &Slot(size_t shard, size_t bucket) const
+        {
+            Line &line = m_lines[shard * m_lines_per_shard + bucket / METRICS_SLOTS_PER_LINE];
+            return line.slots[bucket % METRICS_SLOTS_PER_LINE];
+        }
+
+        std::vector<double> m_bounds;
+        size_t m_lines_per_shard;
+        mutable std::vector<Line> m_lines; // Корзины шарда занимают свои строки кэша
+        SumShard m_sums[METRICS_SHARDS];
+    };
+
+    // Границы корзин для длительностей, с: от 50 мкс до 10 с
+    inline const std::vector<double> &LatencyBuckets()
+    {
+        static const std::vector<double> bounds = {0.00005, 0.0001, 0.00025, 0.0005, 0.001, 0.0025, 0.005,
+                                                   0.01, 0.025, 0.05, 0.1, 0.25, 0.5, 1, 2.5, 10};
+        return bounds;
+    }
+
+    // Метка Prometheus key="value" с экранированием '\\', '"' и перевода строки
+    inline std::string MetricLabel(const std::string &key, const std::string &value)
+    {
+        std::string label = key + "=\"";
+        for (char ch : value)
+        {
+            if (ch == '\\' || ch == '"')
+            {
+                label += '\\';
+                label += ch;
+            }
+            else if (ch == '\n')
+            {
+                label += "\\n";
+            }
+            else
+            {
+                label += ch;
+            }
+        }
+        return label + "\"";
+    }
+
+    // Реестр метрик. Метрики создаются при запуске (под мьютексом) и живут до конца программы,
+    // горячие пути держат ссылки на них и пишут без блокировок. Render выдаёт текстовый формат Prometheus.
+    // Значения, которые уже считаются в другом месте (очереди, порты), подключаются функциями
+    class MetricsRegistry
+    {
+    public:
+        // Счётчик с именем name и метками labels ("a=\"1\",b=\"2\""); повторный вызов возвращает тот же счётчик
+        Counter &GetCounter(const std::string &name, const std::string &help, const std::string &labels = "")
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            Entry &entry = GetEntry(name, help, "counter", labels);
+            if (!entry.counter) entry.counter = std::make_unique<Counter>();
+            return *entry.counter;
+        }
+
+        Gauge &GetGauge(const std::string &name, const std::string &help, const std::string &labels = "")
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            Entry &entry = GetEntry(name, help, "gauge", labels);
+            if (!entry.gauge) entry.gauge = std::make_unique<Gauge>();
+            return *entry.gauge;
+        }
+
+        Histogram &GetHistogram(const std::string &name, const std::string &help, const std::string &labels = "",
+                                const std::vector<double> &bounds = LatencyBuckets())
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            Entry &entry = GetEntry(name, help, "histogram", labels);
+            if (!entry.histogram) entry.histogram = std::make_unique<Histogram>(bounds);
+            return *entry.histogram;
+        }
+
+        // Значение, читаемое при выводе; type - "counter" или "gauge"
+        void AddCallback(const std::string &name, const std::string &help, const std::string &type,
+                         const std::string &labels, std::function<double()> func)
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            GetEntry(name, help, type, labels).callback = std::move(func);
+        }
+
+        std::string Render() const
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            std::string out;
+            for (const auto &family : m_families)
+            {
+                out += "# HELP " + family.name + " " + family.help + "\n";
+                out += "# TYPE " + family.name + " " + family.type + "\n";
+                for (const auto &entry : family.entries)
+                {
+                    std::string labels = entry.labels.empty() ? "" : "{" + entry.labels + "}";
+                    if (entry.counter)
+                    {
+                        out += family.name + labels + " " + std::to_string(entry.counter->Value()) + "\n";
+                    }
+                    else if (entry.gauge)
+                    {
+                        out += family.name + labels + " " + std::to_string(entry.gauge->Value()) + "\n";
+                    }
+                    else if (entry.callback)
+                    {
+                        out += family.name + labels + " " + FormatValue(entry.callback()) + "\n";
+                    }
+                    else if (entry.histogram)
+                    {
+                        RenderHistogram(out, family.name, entry.labels, *entry.histogram);
+                    }
+                }
+            }
+            return out;
+        }
+
+    private:
+        struct Entry
+        {
+            std::string labels;
+            std::unique_ptr<Counter> counter;
+            std::unique_ptr<Gauge> gauge;
+            std::unique_ptr<Histogram> histogram;
+            std::function<double()> callback;
+        };
+
+        struct Family
+        {
+            std::string name;
+            std::string help;
+            std::string type;
+            std::vector<Entry> entries;
+        };
+
+        Entry &GetEntry(const std::string &name, const std::string &help, const std::string &type, const std::string &labels)
+        {
+            auto it = m_family_index.find(name);
+            if (it == m_family_index.end())
+            {
+                it = m_family_index.emplace(name, m_families.size()).first;
+                m_families.push_back({name, help, type, {}});
+            }
+            Family &family = m_families[it->second];
+            for (auto &entry : family.entries)
+            {
+                if (entry.labels == labels) return entry;
+            }
+            family.entries.push_back({labels, nullptr, nullptr, nullptr, nullptr});
+            return family.entries.back();
+        }
+
+        static std::string FormatValue(double value)
+        {
+            char buf[32];
+            // Целые (счётчики из функций) - без потери разрядов, остальное - 10 значащих цифр
+            if (value < 9007199254740992.0 && value > -9007199254740992.0 && value == (double)(int64_t)value)
+            {
+                snprintf(buf, sizeof(buf), "%lld", (long long)value);
+            }
+            else
+            {
+                snprintf(buf, sizeof(buf), "%.10g", value);
+            }
+            return buf;
+        }
+
+        static void RenderHistogram(std::string &out, const std::string &name, const std::string &labels, const Histogram &histogram)
+        {
+            std::string prefix = labels.empty() ? "" : labels + ",";
+            const auto &bounds = histogram.GetBounds();
+            auto buckets = histogram.GetBuckets();
+            uint64_t count = 0;
+            for (size_t i = 0; i < buckets.size(); ++i)
+            {
+                count += buckets[i];
+                std::string le = i < bounds.size() ? FormatValue(bounds[i]) : "+Inf";
+                out += name + "_bucket{" + prefix + "le=\"" + le + "\"} " + std::to_string(count) + "\n";
+            }
+            std::string suffix = labels.empty() ? "" : "{" + labels + "}";
+            out += name + "_sum" + suffix + " " + FormatValue(histogram.GetSum()) + "\n";
+            out += name + "_count" + suffix + " " + std::to_string(count) + "\n";
+        }
+
+        mutable std::mutex m_mutex;
+        std::vector<Family> m_families; // В порядке регистрации
+        std::unordered_map<std::string, size_t> m_family_index;
+    };
+
+    // Общий реестр процесса
+    inline MetricsRegistry &Metrics()
+    {
+        static MetricsRegistry registry;
+        return registry;
+    }
+}
+
+#endif // METRICS_HPP
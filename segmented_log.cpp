@@ -0,0 +1,280 @@
+#include "segmented_log.hpp"
+#include "ts_storage.hpp"
+
+#include <filesystem>
+#include <fstream>
+#include <charconv>
+#include <algorithm>
+#include <mutex>
+#include <chrono>
+
+#ifdef WIN32
+#include <io.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+namespace fs = std::filesystem;
+
+namespace tslib
+{
+    SegmentedLog::~SegmentedLog()
+    {
+        Close();
+    }
+
+    bool SegmentedLog::Open(const std::string &dir, int64_t partition_span, int64_t retention)
+    {
+        Close();
+        if (partition_span <= 0) return false;
+
+        std::error_code ec;
+        fs::create_directories(dir, ec);
+        if (!fs::is_directory(dir, ec)) return false;
+
+        // Манифест - источник истины; без него список восстанавливается по файлам каталога
+        std::vector<int64_t> segments;
+        std::ifstream manifest(dir + "/" + MANIFEST_NAME);
+        std::string name;
+        bool has_manifest = (bool)manifest;
+        while (manifest >> name)
+        {
+            int64_t start = 0;
+            auto res = std::from_chars(name.data(), name.data() + name.size(), start);
+            if (res.ec == std::errc() && fs::exists(dir + "/" + name, ec))
+            {
+                segments.push_back(start);
+            }
+        }
+        if (!has_manifest)
+        {
+            for (const auto &entry : fs::directory_iterator(dir, ec))
+            {
+                if (entry.path().extension() != LOG_SEGMENT_EXTENSION) continue;
+                std::string stem = entry.path().stem().string();
+                int64_t start = 0;
+                auto res = std::from_chars(stem.data(), stem.data() + stem.size(), start);
+                if (res.ec == std::errc() && res.ptr == stem.data() + stem.size())
+                {
+                    segments.push_back(start);
+                }
+            }
+        }
+        std::sort(segments.begin(), segments.end());
+        if (has_manifest)
+        {
+            RemoveUnlisted(dir, segments);
+        }
+
+        std::unique_lock<std::shared_mutex> lock(m_mutex);
+        m_dir = dir;
+        m_span = partition_span;
+        m_retention = retention;
+        m_segments = segments;
+        return WriteManifest();
+    }
+
+    // Сегменты, выведенные из манифеста перед перезапуском, не дождались удаления: список ожидающих
+    // хранится только в памяти. Удаляет файлы сегментов и индексов, которых нет в манифесте, если они
+    // не менялись дольше срока ожидания (более свежий может быть только что созданным сегментом)
+    void SegmentedLog::RemoveUnlisted(const std::string &dir, const std::vector<int64_t> &segments)
+    {
+        std::error_code ec;
+        auto expired = fs::file_time_type::clock::now() - std::chrono::seconds(RETIRED_SEGMENT_GRACE_SEC);
+        std::vector<fs::path> unlisted;
+        for (const auto &entry : fs::directory_iterator(dir, ec))
+        {
+            fs::path log_path = entry.path();
+            if (log_path.extension() == INDEX_EXTENSION) log_path.replace_extension();
+            if (log_path.extension() != LOG_SEGMENT_EXTENSION) continue;
+
+            std::string stem = log_path.stem().string();
+            int64_t start = 0;
+            auto res = std::from_chars(stem.data(), stem.data() + stem.size(), start);
+            if (res.ec != std::errc() || res.ptr != stem.data() + stem.size() ||
+                std::binary_search(segments.begin(), segments.end(), start))
+            {
+                continue;
+            }
+            std::error_code time_ec;
+            auto mtime = fs::last_write_time(entry.path(), time_ec);
+            if (!time_ec && mtime < expired)
+            {
+                unlisted.push_back(entry.path());
+            }
+        }
+        for (const auto &path : unlisted)
+        {
+            fs::remove(path, ec);
+        }
+    }
+
+    void SegmentedLog::Close()
+    {
+        std::unique_lock<std::shared_mutex> lock(m_mutex);
+        if (m_fd >= 0)
+        {
+            close(m_fd);
+        }
+        m_fd = -1;
+        m_fd_segment = INT64_MIN;
+        m_segments.clear();
+        m_retired.clear();
+        m_dir.clear();
+    }
+
+    std::string SegmentedLog::GetSegmentPath(int64_t segment_start) const
+    {
+        return m_dir + "/" + std::to_string(segment_start) + LOG_SEGMENT_EXTENSION;
+    }
+
+    // Пишет манифест во временный файл и переименовывает поверх старого
+    bool SegmentedLog::WriteManifest() const
+    {
+        std::string manifest_path = m_dir + "/" + MANIFEST_NAME;
+        std::string temp_path = manifest_path + ".tmp";
+        {
+            std::ofstream manifest(temp_path, std::ios::trunc);
+            if (!manifest) return false;
+            for (auto start : m_segments)
+            {
+                manifest << start << LOG_SEGMENT_EXTENSION << '\n';
+            }
+            if (!manifest.flush()) return false;
+        }
+        std::error_code ec;
+        fs::rename(temp_path, manifest_path, ec);
+        return !ec;
+    }
+
+    bool SegmentedLog::OpenSegment(int64_t segment_start)
+    {
+        if (m_fd >= 0)
+        {
+            close(m_fd);
+            m_fd = -1;
+        }
+
+        std::string path = GetSegmentPath(segment_start);
+#ifdef WIN32
+        int fd = open(path.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_BINARY, _S_IREAD | _S_IWRITE);
+#else
+        int fd = open(path.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+#endif
+        if (fd < 0) return false;
+
+        std::error_code ec;
+        m_fd = fd;
+        m_fd_segment = segment_start;
+        m_fd_size = fs::file_size(path, ec);
+        m_index.Load(path);
+        if (std::find(m_segments.begin(), m_segments.end(), segment_start) == m_segments.end())
+        {
+            m_segments.push_back(segment_start);
+            std::sort(m_segments.begin(), m_segments.end());
+            WriteManifest();
+        }
+        return true;
+    }
+
+    // Выводит из манифеста сегменты, целиком вышедшие за срок хранения, и удаляет
+    // ранее выведенные, чей срок ожидания истёк
+    void SegmentedLog::ApplyRetention(int64_t now)
+    {
+        bool changed = false;
+        while (!m_segments.empty() && m_segments.front() + m_span <= now - m_retention && m_segments.front() != m_fd_segment)
+        {
+            m_retired.push_back({GetSegmentPath(m_segments.front()), now});
+            m_segments.erase(m_segments.begin());
+            changed = true;
+        }
+        if (changed)
+        {
+            WriteManifest();
+        }
+
+        while (!m_retired.empty() && now - m_retired.front().retired_at >= RETIRED_SEGMENT_GRACE_SEC)
+        {
+            std::error_code ec;
+            fs::remove(m_retired.front().path, ec);
+            fs::remove(TimeIndex::GetIndexPath(m_retired.front().path), ec);
+            m_retired.erase(m_retired.begin());
+        }
+    }
+
+    bool SegmentedLog::Append(int64_t time, double value)
+    {
+        std::unique_lock<std::shared_mutex> lock(m_mutex);
+        if (m_dir.empty()) return false;
+
+        int64_t segment_start = time - ((time % m_span) + m_span) % m_span;
+        if (segment_start != m_fd_segment && !OpenSegment(segment_start))
+        {
+            return false;
+        }
+
+        // Одна запись write на строку: читатели видят только целые строки
+        std::string line;
+        AppendTextRecord(line, time, value);
+        bool ok = write(m_fd, line.data(), line.size()) == (ssize_t)line.size();
+        if (ok)
+        {
+            m_index.Add(time, m_fd_size, m_fd_size + line.size());
+            m_fd_size += line.size();
+        }
+
+        if (m_retention > 0)
+        {
+            ApplyRetention(time);
+        }
+        return ok;
+    }
+
+    std::vector<std::string> SegmentedLog::GetSegmentFiles() const
+    {
+        std::shared_lock<std::shared_mutex> lock(m_mutex);
+        std::vector<std::string> files;
+        files.reserve(m_segments.size());
+        for (auto start : m_segments)
+        {
+            files.push_back(GetSegmentPath(start));
+        }
+        return files;
+    }
+
+    std::vector<std::string> SegmentedLog::GetSegmentFiles(int64_t from, int64_t to) const
+    {
+        std::shared_lock<std::shared_mutex> lock(m_mutex);
+        std::vector<std::string> files;
+        for (auto start : m_segments)
+        {
+            if (start < to && start + m_span > from)
+            {
+                files.push_back(GetSegmentPath(start));
+            }
+        }
+        return files;
+    }
+
+    size_t SegmentedLog::ImportText(const std::string &file_path)
+    {
+        LogColumns columns;
+        if (!ScanLogFile(file_path, columns)) return 0;
+
+        size_t count = 0;
+        for (size_t i = 0; i < columns.Size(); ++i)
+        {
+            if (Append(columns.times[i], columns.values[i])) ++count;
+        }
+        return count;
+    }
+
+    bool SegmentedLog::Empty() const
+    {
+        std::shared_lock<std::shared_mutex> lock(m_mutex);
+        return m_segments.empty();
+    }
+}
@@ -0,0 +1,91 @@
+#ifndef SEGMENTED_LOG_HPP
+#define SEGMENTED_LOG_HPP
+
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <shared_mutex>
+
+#include "time_index.hpp"
+
+namespace tslib
+{
+#define MANIFEST_NAME "MANIFEST"
+#define LOG_SEGMENT_EXTENSION ".log"
+#define RETIRED_SEGMENT_GRACE_SEC 60
+
+    // Текстовый лог "время значение", разбитый на сегменты по времени: <начало>.log в каталоге,
+    // каждый покрывает partition_span секунд. Запись только дописыванием в текущий сегмент,
+    // устаревшие сегменты удаляются целиком. Список актуальных сегментов хранится в MANIFEST
+    // (обновляется атомарно), так что читатель всегда видит согласованный набор файлов.
+    // Выведенный из манифеста сегмент удаляется с диска с задержкой, чтобы дочитались текущие ответы;
+    // не удалённые до перезапуска убираются при открытии
+    class SegmentedLog
+    {
+    public:
+        SegmentedLog() = default;
+        ~SegmentedLog();
+
+        SegmentedLog(const SegmentedLog &) = delete;
+        SegmentedLog &operator=(const SegmentedLog &) = delete;
+
+        // Открывает (создаёт) каталог лога. retention - сколько секунд хранить данные
+        bool Open(const std::string &dir, int64_t partition_span, int64_t retention);
+        void Close();
+        bool IsOpen() const { return !m_dir.empty(); }
+
+        // Дописывает запись и применяет срок хранения (проверяется только самый старый сегмент)
+        bool Append(int64_t time, double value);
+
+        // Пути актуальных сегментов по возрастанию времени
+        std::vector<std::string> GetSegmentFiles() const;
+
+        // Вызывает func(время, значение) для записей с from <= time < to.
+        // Начало интервала в каждом сегменте находится по его индексу <сегмент>.idx
+        template <typename Func>
+        void Query(int64_t from, int64_t to, Func &&func) const
+        {
+            for (const auto &path : GetSegmentFiles(from, to))
+            {
+                TimeIndex index;
+                if (index.Load(path, false))
+                {
+                    QueryTextLog(index, from, to, func);
+                }
+            }
+        }
+
+        // Импортирует текстовый лог "время значение"; возвращает число записей
+        size_t ImportText(const std::string &file_path);
+
+        bool Empty() const;
+        const std::string &GetDir() const { return m_dir; }
+
+    private:
+        std::string GetSegmentPath(int64_t segment_start) const;
+        std::vector<std::string> GetSegmentFiles(int64_t from, int64_t to) const;
+        bool OpenSegment(int64_t segment_start);
+        void ApplyRetention(int64_t now);
+        static void RemoveUnlisted(const std::string &dir, const std::vector<int64_t> &segments);
+        bool WriteManifest() const;
+
+        struct RetiredSegment
+        {
+            std::string path;
+            int64_t retired_at;
+        };
+
+        std::string m_dir;
+        int64_t m_span = 0;
+        int64_t m_retention = 0;
+        std::vector<int64_t> m_segments; // Начала сегментов из манифеста по возрастанию
+        std::vector<RetiredSegment> m_retired; // Ожидают удаления с диска
+        int m_fd = -1; // Текущий сегмент для дозаписи
+        int64_t m_fd_segment = INT64_MIN;
+        uint64_t m_fd_size = 0; // Размер текущего сегмента
+        TimeIndex m_index; // Индекс текущего сегмента, пополняется при дозаписи
+        mutable std::shared_mutex m_mutex; // Защищает список сегментов
+    };
+}
+
+#endif // SEGMENTED_LOG_HPP
@@ -0,0 +1,247 @@
+#pragma once
+
+#include "serial_port.hpp"
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <cstdint>
+#include <cmath>
+
+// Двоичный протокол датчика. Кадр - пакет в кодировке COBS, завершённый байтом 0x00
+// (внутри кадра нулей нет). Пакет после декодирования, числа little-endian:
+//   тип (1 байт, SENSOR_PACKET_SAMPLES), номер пакета (uint16), интервал между измерениями в мс (uint16),
+//   число измерений (uint8), измерения (int16 в сотых долях градуса), CRC-16/CCITT-FALSE всего предыдущего (uint16).
+// Последнее измерение пакета - самое свежее
+#define SENSOR_PACKET_SAMPLES 0x01
+#define SENSOR_PACKET_HEADER_SIZE 6
+#define SENSOR_PACKET_CRC_SIZE 2
+#define SENSOR_PACKET_MAX_SAMPLES 255
+#define SENSOR_VALUE_SCALE 100.0
+#define SENSOR_DETECT_BYTES 256
+
+namespace splib {
+    // CRC-16/CCITT-FALSE (полином 0x1021, начальное значение 0xFFFF)
+    inline uint16_t Crc16(const uint8_t* data, size_t size, uint16_t crc = 0xFFFF) {
+        for (size_t i = 0; i < size; ++i) {
+            crc ^= (uint16_t)data[i] << 8;
+            for (int bit = 0; bit < 8; ++bit)
+                crc = (crc & 0x8000) ? (uint16_t)((crc << 1) ^ 0x1021) : (uint16_t)(crc << 1);
+        }
+        return crc;
+    }
+
+    // Кодирование COBS: на выходе нет нулевых байт; разделитель 0x00 не добавляется
+    inline void CobsEncode(std::string_view in, std::string& out) {
+        out.clear();
+        out.reserve(in.size() + in.size() / 254 + 2);
+        size_t code_pos = out.size();
+        out.push_back(0);
+        uint8_t code = 1;
+        for (char ch : in) {
+            if (ch != 0) {
+                out.push_back(ch);
+                ++code;
+            }
+            if (ch == 0 || code == 0xFF) {
+                out[code_pos] = (char)code;
+                code_pos = out.size();
+                out.push_back(0);
+                code = 1;
+            }
+        }
+        out[code_pos] = (char)code;
+    }
+
+    // Декодирование COBS (без разделителя); false - повреждённый кадр
+    inline bool CobsDecode(std::string_view in, std::string& out) {
+        out.clear();
+        size_t pos = 0;
+        while (pos < in.size()) {
+            uint8_t code = (uint8_t)in[pos++];
+            if (code == 0 || pos + code - 1 > in.size())
+                return false;
+            out.append(in.data() + pos, code - 1);
+            pos += code - 1;
+            if (code != 0xFF && pos < in.size())
+                out.push_back(0);
+        }
+        return true;
+    }
+
+    // Пакет измерений
+    struct SensorPacket {
+        uint16_t seq = 0;
+        uint16_t interval_ms = 0;
+        std::vector<double> values;
+    };
+
+    // Готовый к отправке кадр: пакет с CRC в COBS и завершающий 0x00
+    inline std::string EncodeSensorPacket(const SensorPacket& packet) {
+        std::string raw;
+        size_t count = std::min(packet.values.size(), (size_t)SENSOR_PACKET_MAX_SAMPLES);
+        raw.reserve(SENSOR_PACKET_HEADER_SIZE + count * 2 + SENSOR_PACKET_CRC_SIZE);
+        auto put16 = [&raw](uint16_t value) {
+            raw.push_back((char)(value & 0xFF));
+            raw.push_back((char)(value >> 8));
+        };
+        raw.push_back((char)SENSOR_PACKET_SAMPLES);
+        put16(packet.seq);
+        put16(packet.interval_ms);
+        raw.push_back((char)count);
+        for (size_t i = 0; i < count; ++i)
+            put16((uint16_t)(int16_t)std::lround(packet.values[i] * SENSOR_VALUE_SCALE));
+        put16(Crc16((const uint8_t*)raw.data(), raw.size()));
+
+        std::string frame;
+        CobsEncode(raw, frame);
+        frame.push_back(0);
+        return frame;
+    }
+
+    // Разбор пакета из уже декодированных COBS байт; false - неверная длина, тип или CRC
+    inline bool ParseSensorPacket(std::string_view raw, SensorPacket& packet) {
+        if (raw.size() < SENSOR_PACKET_HEADER_SIZE + SENSOR_PACKET_CRC_SIZE)
+            return false;
+
+        const uint8_t* data = (const uint8_t*)raw.data();
+        auto get16 = [data](size_t pos) -> uint16_t { return (uint16_t)(data[pos] | (data[pos + 1] << 8)); };
+        size_t count = data[5];
+        if (data[0] != SENSOR_PACKET_SAMPLES || raw.size() != SENSOR_PACKET_HEADER_SIZE + count * 2 + SENSOR_PACKET_CRC_SIZE)
+            return false;
+        if (Crc16(data, raw.size() - SENSOR_PACKET_CRC_SIZE) != get16(raw.size() - SENSOR_PACKET_CRC_SIZE))
+            return false;
+
+        packet.seq = get16(1);
+        packet.interval_ms = get16(3);
+        packet.values.resize(count);
+        for (size_t i = 0; i < count; ++i)
+            packet.values[i] = (int16_t)get16(SENSOR_PACKET_HEADER_SIZE + i * 2) / SENSOR_VALUE_SCALE;
+        return true;
+    }
+
+    // Поток датчика поверх SerialPort: определяет формат по первым данным (прежний текст "$-6.87$\n"
+    // или двоичные пакеты), выдаёт кадры и следит за номерами пакетов, считая пропуски
+    class SensorStream {
+    public:
+        enum Format {
+            FORMAT_UNKNOWN,
+            FORMAT_TEXT,
+            FORMAT_BINARY
+        };
+
+        // Принудительный формат вместо автоопределения
+        explicit SensorStream(Format format = FORMAT_UNKNOWN) : _initial_format(format), _format(format) {}
+
+        // Новое подключение: формат определяется заново, нумерация пакетов - с нуля
+        void Reset() {
+            _format = _initial_format;
+            _has_seq = false;
+        }
+
+        // Кадры, пришедшие за один вызов чтения: строки текста без '\n' или декодированные COBS пакеты.
+        // Пока формат не определён, данные копятся в буфере порта
+        int ReadFrames(SerialPort& port, std::vector<std::string>& frames) {
+            if (_format == FORMAT_UNKNOWN) {
+                int ret = port.ReadToBuffer();
+                if (ret != SerialPort::RE_OK)
+                    return ret;
+                Detect(port.PeekBuffer(SENSOR_DETECT_BYTES));
+                if (_format == FORMAT_UNKNOWN)
+                    return SerialPort::RE_OK;
+            }
+
+            if (_format == FORMAT_TEXT) {
+                size_t first = frames.size();
+                int ret = port.ReadFrames(frames, '\n');
+                // Нулевой байт в тексте невозможен: подключились посреди двоичного кадра и ошиблись с форматом
+                for (size_t i = first; i < frames.size(); ++i) {
+                    if (frames[i].find('\0') != std::string::npos) {
+                        _format = FORMAT_BINARY;
+                        frames.resize(first);
+                        break;
+                    }
+                }
+                return ret;
+            }
+
+            size_t first = frames.size();
+            int ret = port.ReadFrames(frames, '\0');
+            // Кадры заменяются декодированными пакетами, испорченные выбрасываются
+            size_t out = first;
+            std::string raw;
+            for (size_t i = first; i < frames.size(); ++i) {
+                if (frames[i].empty())
+                    continue;
+                if (!CobsDecode(frames[i], raw)) {
+                    ++_bad_frames;
+                    continue;
+                }
+                frames[out++].swap(raw);
+            }
+            frames.resize(out);
+            return ret;
+        }
+
+        // Разбор двоичного пакета с учётом пропущенных по номеру пакетов
+        bool ParsePacket(const std::string& raw, SensorPacket& packet) {
+            if (!ParseSensorPacket(raw, packet)) {
+                ++_bad_frames;
+                return false;
+            }
+            if (_has_seq && packet.seq != _next_seq) {
+                uint16_t lost = (uint16_t)(packet.seq - _next_seq);
+                _lost_packets += lost;
+                _lost_samples += (uint64_t)lost * packet.values.size();
+            }
+            _has_seq = true;
+            _next_seq = (uint16_t)(packet.seq + 1);
+            ++_packets;
+            return true;
+        }
+
+        Format GetFormat() const { return _format; }
+        uint64_t GetPackets() const { return _packets; }
+        uint64_t GetBadFrames() const { return _bad_frames; }
+        uint64_t GetLostPackets() const { return _lost_packets; }
+        // Оценка: пропущенные пакеты считаются такого же размера, как следующий за ними
+        uint64_t GetLostSamples() const { return _lost_samples; }
+
+    private:
+        // Нулевой байт встречается только в двоичном потоке (разделитель кадров COBS);
+        // текстовый поток - целая строка из печатных символов. Строки с мусором (подключились
+        // посреди кадра или строки) пропускаются до первой, по которой формат ясен
+        void Detect(const std::string& data) {
+            size_t line = 0;
+            size_t newline;
+            while ((newline = data.find('\n', line)) != std::string::npos) {
+                bool printable = newline > line;
+                for (size_t i = line; i < newline; ++i) {
+                    unsigned char ch = (unsigned char)data[i];
+                    if (ch == 0) {
+                        _format = FORMAT_BINARY;
+                        return;
+                    }
+                    if ((ch < 0x20 && ch != '\r' && ch != '\t') || ch >= 0x7F)
+                        printable = false;
+                }
+                if (printable) {
+                    _format = FORMAT_TEXT;
+                    return;
+                }
+                line = newline + 1;
+            }
+            if (data.find('\0', line) != std::string::npos)
+                _format = FORMAT_BINARY;
+        }
+
+        Format _initial_format;
+        Format _format;
+        bool _has_seq = false;
+        uint16_t _next_seq = 0;
+        uint64_t _packets = 0;
+        uint64_t _bad_frames = 0;
+        uint64_t _lost_packets = 0;
+        uint64_t _lost_samples = 0;
+    };
+}
@@ -0,0 +1,304 @@
+// Имитатор датчиков температуры: открывает псевдотерминалы (или готовые порты) и пишет в них
+// поток измерений в текстовом ("$-6.87$") или двоичном формате с заданной частотой, разбросом,
+// пачками и долей испорченных кадров. Кривая температуры - как в gener_t.py (годовая и суточная)
+#include "serial_port.hpp"
+#include "sensor_protocol.hpp"
+
+#include <string>
+#include <vector>
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <chrono>
+#include <thread>
+#include <random>
+#include <memory>
+#include <algorithm>
+#include <cmath>
+#include <ctime>
+#include <csignal>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <termios.h>
+#include <errno.h>
+
+constexpr size_t MAX_PENDING_BYTES = 65536; // Сверх этого порт считается не успевающим читать
+constexpr double MONTH_TEMPS[] = {-11.6, -7.6, -1.0, 6., 10.7, 14.5, 18.8, 20.6, 16.7, 9.6, -0.1, -8.8};
+
+struct Options {
+    size_t ports = 1;
+    double rate = 10;           // Измерений в секунду на порт
+    double jitter = 0;          // Разброс интервала, доля от него (0..1)
+    bool binary = false;
+    size_t batch = 20;          // Измерений в двоичном пакете
+    double burst_every = 0;     // Каждые N секунд - пачка измерений подряд
+    size_t burst_size = 0;
+    double malformed = 0;       // Доля испорченных кадров
+    double drop = 0;            // Доля пропущенных двоичных пакетов (пропуски в номерах)
+    double duration = 0;        // Секунд работы, 0 - бесконечно
+    double speedup = 1;         // Во сколько раз модельное время идёт быстрее реального
+    std::string config;         // Файл "id порт" для сервера (./test @файл)
+    std::vector<std::string> devices; // Готовые порты вместо псевдотерминалов
+};
+
+// Температура как в gener_t.py: линейно между средними месяцев плюс суточный ход
+double GetMonthTemp(double t_month) {
+    int month = (int)t_month;
+    double start = MONTH_TEMPS[month];
+    double end = MONTH_TEMPS[month > 10 ? 0 : month + 1];
+    double t = t_month - month;
+    return start * (1 - t) + end * t;
+}
+
+double GetDayTemp(double t_day) {
+    if (t_day < 0.25) return -4 - 2 * (t_day * 4);
+    if (t_day < 0.5) return -6 + 14 * (t_day - 0.25) * 4;
+    if (t_day < 0.75) return 8 - 4 * (t_day - 0.5) * 4;
+    return 4 - 8 * (t_day - 0.75) * 4;
+}
+
+double GetModelTemp(time_t model_time) {
+    std::tm tm = *localtime(&model_time);
+    double t_day = (tm.tm_hour * 3600 + tm.tm_min * 60 + tm.tm_sec) / 86400.0;
+    double t_month = tm.tm_mon + tm.tm_mday / 31.0;
+    return GetMonthTemp(std::min(t_month, 11.999)) + GetDayTemp(t_day);
+}
+
+// Один имитируемый датчик: куда писать, расписание и накопленный пакет
+struct SimPort {
+    std::string name;
+    int master_fd = -1;         // Ведущая сторона псевдотерминала
+    int slave_fd = -1;          // Держим открытой, чтобы порт не "вешался" при переподключении читателя
+    splib::SerialPort port;     // Либо готовый порт
+    std::string pending;        // Не влезло в буфер порта
+    splib::SensorPacket packet;
+    uint16_t seq = 0;
+    std::chrono::steady_clock::time_point next_sample;
+    std::chrono::steady_clock::time_point next_burst;
+    double offset = 0;          // Сдвиг температуры датчика
+
+    uint64_t samples = 0;
+    uint64_t bytes = 0;
+    uint64_t dropped_bytes = 0;
+};
+
+bool OpenPty(SimPort& sim) {
+    sim.master_fd = posix_openpt(O_RDWR | O_NOCTTY);
+    if (sim.master_fd < 0 || grantpt(sim.master_fd) != 0 || unlockpt(sim.master_fd) != 0) return false;
+
+    const char* name = ptsname(sim.master_fd);
+    if (name == nullptr) return false;
+    sim.name = name;
+
+    // Сырой режим: без эха и преобразования переводов строк
+    sim.slave_fd = open(name, O_RDWR | O_NOCTTY);
+    if (sim.slave_fd < 0) return false;
+    termios tio;
+    if (tcgetattr(sim.slave_fd, &tio) == 0) {
+        cfmakeraw(&tio);
+        tcsetattr(sim.slave_fd, TCSANOW, &tio);
+    }
+    fcntl(sim.master_fd, F_SETFL, fcntl(sim.master_fd, F_GETFL) | O_NONBLOCK);
+    return true;
+}
+
+// Пишет сколько влезет; остаток ждёт следующего раза, при переполнении новые данные отбрасываются
+void Flush(SimPort& sim) {
+    if (sim.pending.empty()) return;
+    if (sim.master_fd < 0) {
+        sim.port.Write(sim.pending);
+        sim.bytes += sim.pending.size();
+        sim.pending.clear();
+        return;
+    }
+    ssize_t written = write(sim.master_fd, sim.pending.data(), sim.pending.size());
+    if (written > 0) {
+        sim.bytes += written;
+        sim.pending.erase(0, written);
+    }
+}
+
+void Send(SimPort& sim, const std::string& data) {
+    if (sim.pending.size() + data.size() > MAX_PENDING_BYTES) {
+        sim.dropped_bytes += data.size();
+        return;
+    }
+    sim.pending += data;
+}
+
+void EmitSample(SimPort& sim, const Options& opt, double value, std::mt19937& rng) {
+    std::uniform_real_distribution<double> unit(0, 1);
+    bool malformed = unit(rng) < opt.malformed;
+    ++sim.samples;
+
+    if (!opt.binary) {
+        char line[32];
+        int size = snprintf(line, sizeof(line), "$%.2f$\n", value);
+        if (malformed) line[1 + rng() % (size - 3)] = "#x\x01"[rng() % 3]; // Портим символ числа
+        Send(sim, std::string(line, size));
+        return;
+    }
+
+    sim.packet.values.push_back(value);
+    if (sim.packet.values.size() < opt.batch) return;
+
+    sim.packet.seq = sim.seq++;
+    sim.packet.interval_ms = (uint16_t)std::min(1000.0 / opt.rate, 65535.0);
+    std::string frame = splib::EncodeSensorPacket(sim.packet);
+    sim.packet.values.clear();
+    if (unit(rng) < opt.drop) return;
+    if (malformed) {
+        // Портим байт, не создавая лишнего разделителя 0x00
+        char& byte = frame[rng() % (frame.size() - 1)];
+        byte ^= 0x5A;
+        if (byte == 0) byte = 0x01;
+    }
+    Send(sim, frame);
+}
+
+bool ParseOptions(int argc, char** argv, Options& opt) {
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        size_t eq = arg.find('=');
+        std::string key = arg.substr(0, eq);
+        std::string value = eq == std::string::npos ? "" : arg.substr(eq + 1);
+        try {
+            if (key == "--ports") opt.ports = std::stoul(value);
+            else if (key == "--rate") opt.rate = std::stod(value);
+            else if (key == "--jitter") opt.jitter = std::stod(value);
+            else if (key == "--format") opt.binary = (value == "binary");
+            else if (key == "--batch") opt.batch = std::max<size_t>(1, std::min<size_t>(std::stoul(value), SENSOR_PACKET_MAX_SAMPLES));
+            else if (key == "--burst-every") opt.burst_every = std::stod(value);
+            else if (key == "--burst-size") opt.burst_size = std::stoul(value);
+            else if (key == "--malformed") opt.malformed = std::stod(value);
+            else if (key == "--drop") opt.drop = std::stod(value);
+            else if (key == "--duration") opt.duration = std::stod(value);
+            else if (key == "--speedup") opt.speedup = std::stod(value);
+            else if (key == "--config") opt.config = value;
+            else if (key == "--device") {
+                std::stringstream list(value);
+                std::string device;
+                while (std::getline(list, device, ',')) opt.devices.push_back(device);
+            } else {
+                return false;
+            }
+        } catch (...) {
+            return false;
+        }
+    }
+    // Доли и джиттер - из [0, 1]: при джиттере больше 1 шаг становится отрицательным и генерация зацикливается
+    auto is_ratio = [](double value) { return value >= 0 && value <= 1; };
+    return opt.rate > 0 && opt.speedup > 0 && is_ratio(opt.jitter) && is_ratio(opt.malformed) && is_ratio(opt.drop) &&
+           opt.burst_every >= 0;
+}
+
+volatile std::sig_atomic_t stop_requested = 0;
+
+int main(int argc, char** argv) {
+    Options opt;
+    if (!ParseOptions(argc, argv, opt)) {
+        std::cerr << "Usage: " << argv[0] << " [--ports=N] [--rate=HZ] [--jitter=0..1] [--format=text|binary] [--batch=N]\n"
+                  << "    [--burst-every=SEC --burst-size=N] [--malformed=RATIO] [--drop=RATIO] [--duration=SEC]\n"
+                  << "    [--speedup=K] [--config=FILE] [--device=PORT1,PORT2,...]" << std::endl;
+        return 1;
+    }
+    std::signal(SIGINT, [](int) { stop_requested = 1; });
+    std::signal(SIGTERM, [](int) { stop_requested = 1; });
+
+    std::vector<std::unique_ptr<SimPort>> sims;
+    size_t count = opt.devices.empty() ? opt.ports : opt.devices.size();
+    for (size_t i = 0; i < count; ++i) {
+        auto sim = std::make_unique<SimPort>();
+        if (opt.devices.empty()) {
+            if (!OpenPty(*sim)) {
+                std::cerr << "Failed to open pty" << std::endl;
+                return 1;
+            }
+        } else {
+            sim->name = opt.devices[i];
+            if (sim->port.Open(sim->name, splib::SerialPort::Parameters(splib::SerialPort::BAUDRATE_115200)) != splib::SerialPort::RE_OK) {
+                std::cerr << "Failed to open port: " << sim->name << std::endl;
+                return 1;
+            }
+        }
+        sim->offset = (double)i * 0.5;
+        sims.push_back(std::move(sim));
+    }
+
+    // Порты для сервера: по строке "id порт"
+    std::ofstream config;
+    if (!opt.config.empty()) config.open(opt.config, std::ios::trunc);
+    for (size_t i = 0; i < sims.size(); ++i) {
+        std::cout << "sensor" << i << " " << sims[i]->name << std::endl;
+        if (config) config << "sensor" << i << " " << sims[i]->name << "\n";
+    }
+    if (config.is_open()) config.close();
+
+    std::mt19937 rng(std::random_device{}());
+    std::uniform_real_distribution<double> jitter(-opt.jitter, opt.jitter);
+    std::normal_distribution<double> noise(0, 0.05);
+
+    auto interval = std::chrono::duration<double>(1.0 / opt.rate);
+    auto start = std::chrono::steady_clock::now();
+    time_t model_start = time(nullptr);
+    for (auto& sim : sims) {
+        sim->next_sample = start;
+        sim->next_burst = start + std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(opt.burst_every));
+    }
+
+    // Строка статистики раз в секунду: измерения, байты и отброшенное за секунду по всем портам
+    auto next_report = start + std::chrono::seconds(1);
+    uint64_t last_samples = 0, last_bytes = 0, last_dropped = 0;
+
+    while (!stop_requested) {
+        auto now = std::chrono::steady_clock::now();
+        double elapsed = std::chrono::duration<double>(now - start).count();
+        if (opt.duration > 0 && elapsed >= opt.duration) break;
+
+        time_t model_time = model_start + (time_t)(elapsed * opt.speedup);
+        double base_temp = GetModelTemp(model_time);
+
+        auto next_wake = next_report;
+        for (auto& sim : sims) {
+            while (sim->next_sample <= now) {
+                EmitSample(*sim, opt, base_temp + sim->offset + noise(rng), rng);
+                auto step = interval * (1 + jitter(rng));
+                sim->next_sample += std::chrono::duration_cast<std::chrono::steady_clock::duration>(step);
+            }
+            if (opt.burst_every > 0 && opt.burst_size > 0 && sim->next_burst <= now) {
+                for (size_t i = 0; i < opt.burst_size; ++i) {
+                    EmitSample(*sim, opt, base_temp + sim->offset + noise(rng), rng);
+                }
+                sim->next_burst += std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(opt.burst_every));
+            }
+            Flush(*sim);
+            next_wake = std::min(next_wake, sim->next_sample);
+            if (!sim->pending.empty()) next_wake = std::min(next_wake, now + std::chrono::milliseconds(1));
+        }
+
+        if (now >= next_report) {
+            uint64_t samples = 0, bytes = 0, dropped = 0;
+            for (auto& sim : sims) {
+                samples += sim->samples;
+                bytes += sim->bytes;
+                dropped += sim->dropped_bytes;
+            }
+            std::cout << "elapsed=" << (int64_t)elapsed << " samples_per_sec=" << samples - last_samples
+                      << " bytes_per_sec=" << bytes - last_bytes << " dropped_bytes=" << dropped - last_dropped << std::endl;
+            last_samples = samples;
+            last_bytes = bytes;
+            last_dropped = dropped;
+            next_report += std::chrono::seconds(1);
+        }
+
+        std::this_thread::sleep_until(next_wake);
+    }
+
+    for (auto& sim : sims) {
+        Flush(*sim);
+        if (sim->master_fd >= 0) close(sim->master_fd);
+        if (sim->slave_fd >= 0) close(sim->slave_fd);
+    }
+    return 0;
+}
@@ -17,12 +17,15 @@ typedef termios MyPortSettings;
 #endif
 
 #include <string>
+#include <vector>
+#include <algorithm>
 #include <cstring>
 #include <cstdint>
 
 #define MY_PORT_READ_BUF 1500
 #define MY_PORT_WRITE_BUF 1500
 #define SERIAL_PORT_DEFAULT_TIMEOUT 1.0
+#define SERIAL_PORT_MIN_RING_SIZE 64
 
 namespace splib {
     class SerialPort {
@@ -92,7 +95,8 @@ namespace splib {
             RE_PORT_NOT_CONNECTED,
             RE_PORT_SYSTEM_ERROR,
             RE_PORT_WRITE_FAILED,
-            RE_PORT_READ_FAILED
+            RE_PORT_READ_FAILED,
+            RE_PORT_NO_DATA
         };
 
         // Параметры серийного порта
@@ -141,6 +145,70 @@ namespace splib {
         std::string _port_name;
         double _timeout;
 
+        // Кольцевой буфер приёма: данные, прочитанные из порта, но ещё не выданные целыми кадрами
+        std::vector<char> _rx_ring;
+        size_t _rx_head = 0;     // Начало непрочитанных данных
+        size_t _rx_count = 0;    // Сколько байт в буфере
+        size_t _rx_scanned = 0;  // Столько байт от начала уже просмотрено - разделителя в них нет
+        uint64_t _rx_dropped = 0; // Байт отброшено из-за кадров длиннее буфера
+        uint64_t _rx_received = 0; // Байт прочитано из порта за всё время
+
+        // Дочитать из порта в свободную часть кольцевого буфера (один системный вызов)
+        int FillRing(size_t* readd) {
+            *readd = 0;
+            if (_rx_ring.empty())
+                return RE_PORT_NOT_CONNECTED;
+
+            size_t cap = _rx_ring.size();
+            if (_rx_count == cap) {
+                // Кадр не помещается в буфер - отбрасываем его начало
+                _rx_dropped += _rx_count;
+                _rx_head = 0;
+                _rx_count = 0;
+                _rx_scanned = 0;
+            }
+
+            size_t tail = (_rx_head + _rx_count) % cap;
+            size_t free_size = (tail >= _rx_head) ? cap - tail : _rx_head - tail;
+            if (_rx_count == 0) {
+                _rx_head = 0;
+                tail = 0;
+                free_size = cap;
+            }
+
+            int ret = Read(&_rx_ring[tail], free_size, readd);
+            if (ret == RE_OK) {
+                _rx_count += *readd;
+                _rx_received += *readd;
+            }
+            return ret;
+        }
+
+        // Извлечь из буфера один кадр до разделителя (без него); false - целого кадра нет
+        bool ExtractFrame(std::string& frame, char delimiter) {
+            size_t cap = _rx_ring.size();
+            while (_rx_scanned < _rx_count) {
+                size_t pos = (_rx_head + _rx_scanned) % cap;
+                size_t len = std::min(_rx_count - _rx_scanned, cap - pos);
+                const char* found = (const char*)memchr(&_rx_ring[pos], delimiter, len);
+                if (!found) {
+                    _rx_scanned += len;
+                    continue;
+                }
+
+                size_t frame_size = _rx_scanned + (size_t)(found - &_rx_ring[pos]);
+                size_t first = std::min(frame_size, cap - _rx_head);
+                frame.assign(&_rx_ring[_rx_head], first);
+                frame.append(_rx_ring.data(), frame_size - first);
+
+                _rx_head = (_rx_head + frame_size + 1) % cap;
+                _rx_count -= frame_size + 1;
+                _rx_scanned = 0;
+                return true;
+            }
+            return false;
+        }
+
         // Открыть порт
         int CreatePortHandle(const std::string& name) {
 #if defined(WIN32)
@@ -271,6 +339,8 @@ namespace splib {
                 return ret;
 
             _port_name = port_name;
+            _rx_ring.assign(std::max(params.read_buffer_size, (size_t)SERIAL_PORT_MIN_RING_SIZE), 0);
+            _rx_head = _rx_count = _rx_scanned = 0;
             ret = SetParameters(params);
             if (ret != RE_OK)
                 Close();
@@ -286,6 +356,8 @@ namespace splib {
             int ret = ClosePortHandle();
             _timeout = 0.0;
             _port_name.clear();
+            _rx_ring.clear();
+            _rx_head = _rx_count = _rx_scanned = 0;
             return ret;
         }
 
@@ -294,6 +366,45 @@ namespace splib {
             return (_phandle != MY_INVALID_HANDLE);
         }
 
+        // Получить дескриптор порта (для poll)
+        MyPortHandle GetHandle() const {
+            return _phandle;
+        }
+
+        // Неблокирующий режим: чтение без данных сразу возвращает 0 байт
+        int SetNonBlocking(bool enable) {
+            if (!IsOpen())
+                return RE_PORT_NOT_CONNECTED;
+
+#if defined(WIN32)
+            COMMTIMEOUTS tmts;
+            if (!GetCommTimeouts(_phandle, &tmts))
+                return RE_PORT_PARAMETERS_GET_FAILED;
+
+            if (enable) {
+                tmts.ReadIntervalTimeout = MAXDWORD;
+                tmts.ReadTotalTimeoutMultiplier = 0;
+                tmts.ReadTotalTimeoutConstant = 0;
+            } else {
+                tmts.ReadIntervalTimeout = 0;
+                tmts.ReadTotalTimeoutConstant = (DWORD)(_timeout * 1e3);
+            }
+
+            if (!SetCommTimeouts(_phandle, &tmts))
+                return RE_PORT_PARAMETERS_SET_FAILED;
+#else
+            int flags = fcntl(_phandle, F_GETFL, 0);
+            if (flags < 0)
+                return RE_PORT_PARAMETERS_GET_FAILED;
+
+            flags = enable ? (flags | O_NONBLOCK) : (flags & ~O_NONBLOCK);
+            if (fcntl(_phandle, F_SETFL, flags) < 0)
+                return RE_PORT_PARAMETERS_SET_FAILED;
+#endif
+
+            return RE_OK;
+        }
+
         // Получить имя порта
         const std::string& GetPortName() {
             return _port_name;
@@ -397,8 +508,12 @@ namespace splib {
             *readd = (size_t)feedback;
 #else
             ssize_t result = read(_phandle, buf, max_size);
-            if (result < 0)
+            if (result < 0) {
+                // В неблокирующем режиме отсутствие данных - не ошибка
+                if (errno == EAGAIN || errno == EWOULDBLOCK)
+                    return RE_OK;
                 return RE_PORT_READ_FAILED;
+            }
 
             *readd = (size_t)result;
 #endif
@@ -406,20 +521,102 @@ namespace splib {
             return RE_OK;
         }
 
-        // Чтение строки из порта
+        // Чтение строки из порта: то, что есть в буфере приёма, иначе один вызов чтения
         int Read(std::string& str, double timeout = SERIAL_PORT_DEFAULT_TIMEOUT) {
+            (void)timeout; // Таймаут задаётся параметрами порта
             str.clear();
-            str.reserve(255);
+            if (_rx_count > 0) {
+                size_t first = std::min(_rx_count, _rx_ring.size() - _rx_head);
+                str.assign(&_rx_ring[_rx_head], first);
+                str.append(_rx_ring.data(), _rx_count - first);
+                _rx_head = _rx_count = _rx_scanned = 0;
+                return RE_OK;
+            }
+
+            char buf[255];
             size_t rd = 0;
+            int ret = Read(buf, sizeof(buf), &rd);
+            if (ret != RE_OK)
+                return ret;
+
+            str.assign(buf, rd);
+            return ret;
+        }
+
+        // Чтение одной строки до разделителя (без него). Читает из порта, только если
+        // в буфере нет целой строки; RE_PORT_NO_DATA - за таймаут строка не пришла
+        int ReadLine(std::string& line, char delimiter = '\n') {
+            if (!IsOpen())
+                return RE_PORT_NOT_CONNECTED;
+
+            while (!ExtractFrame(line, delimiter)) {
+                size_t rd = 0;
+                int ret = FillRing(&rd);
+                if (ret != RE_OK)
+                    return ret;
+                if (rd == 0)
+                    return RE_PORT_NO_DATA;
+            }
+            return RE_OK;
+        }
 
-            int ret = Read((void*)str.c_str(), str.capacity(), &rd);
+        // Чтение всех целых кадров, пришедших за один вызов чтения (и оставшихся в буфере).
+        // Кадры дописываются в frames; незавершённый хвост остаётся до следующего вызова
+        int ReadFrames(std::vector<std::string>& frames, char delimiter = '\n') {
+            if (!IsOpen())
+                return RE_PORT_NOT_CONNECTED;
+
+            size_t before = frames.size();
+            std::string frame;
+            while (ExtractFrame(frame, delimiter))
+                frames.push_back(std::move(frame));
+            if (frames.size() > before)
+                return RE_OK;
+
+            size_t rd = 0;
+            int ret = FillRing(&rd);
             if (ret != RE_OK)
                 return ret;
 
-            str.resize(rd);
+            while (ExtractFrame(frame, delimiter))
+                frames.push_back(std::move(frame));
+            return RE_OK;
+        }
+
+        // Дочитать из порта в буфер приёма, не извлекая кадров (один вызов чтения)
+        int ReadToBuffer(size_t* readd = NULL) {
+            if (!IsOpen())
+                return RE_PORT_NOT_CONNECTED;
+
+            size_t rd = 0;
+            int ret = FillRing(&rd);
+            if (readd)
+                *readd = rd;
             return ret;
         }
 
+        // Копия начала буфера приёма (не более max_size байт) без извлечения
+        std::string PeekBuffer(size_t max_size) const {
+            size_t size = std::min(max_size, _rx_count);
+            size_t first = std::min(size, _rx_ring.size() - _rx_head);
+            std::string data;
+            if (size == 0)
+                return data;
+            data.assign(&_rx_ring[_rx_head], first);
+            data.append(_rx_ring.data(), size - first);
+            return data;
+        }
+
+        // Сколько байт отброшено из-за кадров, не поместившихся в буфер приёма
+        uint64_t GetDroppedBytes() const {
+            return _rx_dropped;
+        }
+
+        // Сколько байт прочитано из порта через буфер приёма (с учётом переоткрытий)
+        uint64_t GetReceivedBytes() const {
+            return _rx_received;
+        }
+
         // Очистка буферов
         int Flush() {
             if (!IsOpen())
@@ -431,6 +628,7 @@ namespace splib {
 #else
             tcflush(_phandle, TCIOFLUSH);
 #endif
+            _rx_head = _rx_count = _rx_scanned = 0;
 
             return RE_OK;
         }
@@ -0,0 +1,114 @@
+#ifndef SPSC_QUEUE_HPP
+#define SPSC_QUEUE_HPP
+
+#include <atomic>
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+
+namespace utillib
+{
+#define SPSC_CACHE_LINE 64
+
+    // Ограниченная очередь без блокировок для одного писателя и одного читателя.
+    // Push и Pop не ждут никогда: при заполненной очереди элемент отбрасывается и учитывается в GetOverflows.
+    // Индексы только растут, позиция в буфере - индекс по маске (ёмкость - степень двойки).
+    // Каждая сторона держит копию чужого индекса и перечитывает его, только когда копия говорит "полно"/"пусто"
+    template <typename T>
+    class SpscQueue
+    {
+    public:
+        explicit SpscQueue(size_t capacity)
+        {
+            size_t size = 2;
+            while (size < capacity)
+            {
+                size <<= 1;
+            }
+            m_buffer.resize(size);
+            m_mask = size - 1;
+        }
+
+        SpscQueue(const SpscQueue &) = delete;
+        SpscQueue &operator=(const SpscQueue &) = delete;
+
+        // Вызывается только писателем; false - очередь полна, элемент отброшен
+        bool Push(const T &item)
+        {
+            size_t head = m_head.load(std::memory_order_relaxed);
+            if (head - m_cached_tail > m_mask)
+            {
+                m_cached_tail = m_tail.load(std::memory_order_acquire);
+                if (head - m_cached_tail > m_mask)
+                {
+                    m_overflows.fetch_add(1, std::memory_order_relaxed);
+                    return false;
+                }
+            }
+
+            m_buffer[head & m_mask] = item;
+            m_head.store(head + 1, std::memory_order_release);
+            m_head.notify_one();
+            return true;
+        }
+
+        // Вызывается только читателем; false - очередь пуста
+        bool Pop(T &item)
+        {
+            size_t tail = m_tail.load(std::memory_order_relaxed);
+            if (tail == m_cached_head)
+            {
+                m_cached_head = m_head.load(std::memory_order_acquire);
+                if (tail == m_cached_head) return false;
+
+                // Накопившееся, пока читатель был занят, - точная занятость на этот момент
+                size_t size = m_cached_head - tail;
+                if (size > m_max_size.load(std::memory_order_relaxed))
+                {
+                    m_max_size.store(size, std::memory_order_relaxed);
+                }
+            }
+
+            item = std::move(m_buffer[tail & m_mask]);
+            m_tail.store(tail + 1, std::memory_order_release);
+            return true;
+        }
+
+        // Вызывается только читателем: ждёт, пока в очереди появится элемент
+        void Wait()
+        {
+            size_t head = m_head.load(std::memory_order_acquire);
+            while (head == m_tail.load(std::memory_order_relaxed))
+            {
+                m_head.wait(head, std::memory_order_acquire);
+                head = m_head.load(std::memory_order_acquire);
+            }
+        }
+
+        // Занятость очереди; из постороннего потока - приблизительно
+        size_t Size() const
+        {
+            return m_head.load(std::memory_order_acquire) - m_tail.load(std::memory_order_acquire);
+        }
+
+        size_t Capacity() const { return m_mask + 1; }
+
+        // Наибольшая занятость, замеченная читателем при перечитывании m_head
+        size_t GetMaxSize() const { return m_max_size.load(std::memory_order_relaxed); }
+        uint64_t GetOverflows() const { return m_overflows.load(std::memory_order_relaxed); }
+
+    private:
+        std::vector<T> m_buffer;
+        size_t m_mask = 0;
+
+        alignas(SPSC_CACHE_LINE) std::atomic<size_t> m_head{0}; // Следующая позиция записи
+        size_t m_cached_tail = 0; // Копия m_tail у писателя
+        std::atomic<uint64_t> m_overflows{0};
+
+        alignas(SPSC_CACHE_LINE) std::atomic<size_t> m_tail{0}; // Следующая позиция чтения
+        size_t m_cached_head = 0; // Копия m_head у читателя
+        std::atomic<size_t> m_max_size{0};
+    };
+}
+
+#endif // SPSC_QUEUE_HPP
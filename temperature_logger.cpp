@@ -1,4 +1,7 @@
 #include "serial_port.hpp"
+#include "time_index.hpp"
+#include "log_parser.hpp"
+#include "sensor_protocol.hpp"
 #include <iostream>
 #include <fstream>
 #include <string>
@@ -6,12 +9,19 @@
 #include <chrono>
 #include <vector>
 #include <numeric>
+#include <cstdio>
+#include <algorithm>
 #include <filesystem>
 
 #ifdef _WIN32
 #include <windows.h>
+#include <io.h>
+#include <fcntl.h>
+#include <sys/stat.h>
 #else
 #include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
 #endif
 
 namespace fs = std::filesystem;
@@ -20,43 +30,231 @@ constexpr char LOG_ALL_FILE[] = "temperature_log_all.txt";
 constexpr char LOG_HOURLY_FILE[] = "temperature_log_hourly.txt";
 constexpr char LOG_DAILY_FILE[] = "temperature_log_daily.txt";
 
+constexpr int POLL_TIMEOUT_MS = 100;
+// A lost port is reopened after PORT_RETRY_DELAY, doubling up to PORT_RETRY_MAX_DELAY while it stays unavailable
+constexpr auto PORT_RETRY_DELAY = std::chrono::seconds(1);
+constexpr auto PORT_RETRY_MAX_DELAY = std::chrono::seconds(30);
+
 constexpr int SECONDS_IN_HOUR = 3600;
 constexpr int SECONDS_IN_DAY = 86400;
 
-// Append a temperature value to a log file
-void append_to_log(const std::string &filename, const std::string &entry) {
-    std::ofstream file(filename, std::ios::app);
-    if (file) {
-        file << entry << std::endl;
-    }
+constexpr size_t DEFAULT_BATCH_LINES = 256;
+constexpr auto DEFAULT_BATCH_DELAY = std::chrono::milliseconds(1000);
+constexpr auto DEFAULT_SYNC_INTERVAL = std::chrono::milliseconds(5000);
+
+// When committed batches are forced to stable storage
+enum class durability_policy {
+    none,              // Leave it to the OS page cache
+    sync_per_batch,    // fdatasync after every committed batch
+    sync_per_interval  // fdatasync at most once per sync interval
+};
+
+durability_policy parse_durability_policy(const std::string &name) {
+    if (name == "batch") return durability_policy::sync_per_batch;
+    if (name == "interval") return durability_policy::sync_per_interval;
+    return durability_policy::none;
 }
 
-// Prune log file entries older than a certain threshold
-void prune_log(const std::string &filename, std::chrono::hours retention_period) {
-    std::ifstream file(filename);
-    if (!file) return;
+// Achieved group-commit sizes of a log writer
+struct batch_stats {
+    uint64_t batches = 0;
+    uint64_t lines = 0;
+    uint64_t max_batch_lines = 0;
+    uint64_t syncs = 0;
+
+    double average_batch_lines() const { return batches > 0 ? (double)lines / batches : 0.0; }
+};
+
+// Append-only log writer that keeps the file open and commits lines in groups:
+// a batch is written with one write() once it holds max_lines lines or its first line is max_delay old
+class batched_log_writer {
+public:
+    batched_log_writer(const std::string &filename, durability_policy policy,
+                       size_t max_lines = DEFAULT_BATCH_LINES,
+                       std::chrono::milliseconds max_delay = DEFAULT_BATCH_DELAY,
+                       std::chrono::milliseconds sync_interval = DEFAULT_SYNC_INTERVAL)
+        : filename_(filename), policy_(policy), max_lines_(max_lines), max_delay_(max_delay), sync_interval_(sync_interval) {
+        open();
+    }
+
+    ~batched_log_writer() {
+        commit();
+        sync();
+        close();
+    }
+
+    batched_log_writer(const batched_log_writer &) = delete;
+    batched_log_writer &operator=(const batched_log_writer &) = delete;
 
-    std::vector<std::string> lines;
-    std::string line;
-    auto now = std::chrono::system_clock::now();
+    // Buffer a line; commits the batch if it is full or overdue
+    void append(const std::string &entry) {
+        if (pending_lines_ == 0) {
+            batch_started_ = std::chrono::steady_clock::now();
+        }
+        buffer_ += entry;
+        buffer_ += '\n';
+        ++pending_lines_;
+        if (pending_lines_ >= max_lines_) {
+            commit();
+        } else {
+            poll();
+        }
+    }
+
+    // Commit an overdue batch and run an interval sync if one is due; call periodically when idle
+    void poll() {
+        auto now = std::chrono::steady_clock::now();
+        if (pending_lines_ > 0 && now - batch_started_ >= max_delay_) {
+            commit();
+        }
+        if (policy_ == durability_policy::sync_per_interval && unsynced_ && now - last_sync_ >= sync_interval_) {
+            sync();
+        }
+    }
 
-    while (std::getline(file, line)) {
-        auto timestamp_pos = line.find_first_of(' ');
-        if (timestamp_pos != std::string::npos) {
-            auto timestamp = std::stoll(line.substr(0, timestamp_pos));
-            auto log_time = std::chrono::system_clock::time_point{std::chrono::seconds{timestamp}};
+    // Write out whatever is buffered
+    void commit() {
+        if (pending_lines_ == 0) return;
+        if (fd_ < 0) open();
 
-            if (now - log_time <= retention_period) {
-                lines.push_back(line);
+        const char *data = buffer_.data();
+        size_t left = buffer_.size();
+        while (fd_ >= 0 && left > 0) {
+#ifdef _WIN32
+            int written = _write(fd_, data, (unsigned int)left);
+#else
+            ssize_t written = write(fd_, data, left);
+#endif
+            if (written <= 0) {
+                std::cerr << "Failed to write log: " << filename_ << std::endl;
+                break;
             }
+            data += written;
+            left -= written;
+        }
+
+        stats_.batches++;
+        stats_.lines += pending_lines_;
+        stats_.max_batch_lines = std::max<uint64_t>(stats_.max_batch_lines, pending_lines_);
+        buffer_.clear();
+        pending_lines_ = 0;
+        unsynced_ = true;
+
+        if (policy_ == durability_policy::sync_per_batch) {
+            sync();
+        }
+    }
+
+    // Commit and reopen the file, e.g. after it was replaced by prune_log
+    void reopen() {
+        commit();
+        sync();
+        close();
+        open();
+    }
+
+    const batch_stats &stats() const { return stats_; }
+    const std::string &filename() const { return filename_; }
+
+private:
+    void open() {
+#ifdef _WIN32
+        fd_ = _open(filename_.c_str(), _O_WRONLY | _O_CREAT | _O_APPEND | _O_BINARY, _S_IREAD | _S_IWRITE);
+#else
+        fd_ = ::open(filename_.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+#endif
+        if (fd_ < 0) {
+            std::cerr << "Failed to open log: " << filename_ << std::endl;
         }
     }
 
+    void close() {
+        if (fd_ < 0) return;
+#ifdef _WIN32
+        _close(fd_);
+#else
+        ::close(fd_);
+#endif
+        fd_ = -1;
+    }
+
+    void sync() {
+        last_sync_ = std::chrono::steady_clock::now();
+        if (fd_ < 0 || !unsynced_ || policy_ == durability_policy::none) return;
+#ifdef _WIN32
+        _commit(fd_);
+#else
+        fdatasync(fd_);
+#endif
+        unsynced_ = false;
+        stats_.syncs++;
+    }
+
+    std::string filename_;
+    durability_policy policy_;
+    size_t max_lines_;
+    std::chrono::milliseconds max_delay_;
+    std::chrono::milliseconds sync_interval_;
+    int fd_ = -1;
+    std::string buffer_;
+    size_t pending_lines_ = 0;
+    std::chrono::steady_clock::time_point batch_started_;
+    std::chrono::steady_clock::time_point last_sync_ = std::chrono::steady_clock::now();
+    bool unsynced_ = false;
+    batch_stats stats_;
+};
+
+void print_batch_stats(const batched_log_writer &writer) {
+    const auto &stats = writer.stats();
+    std::cout << writer.filename() << ": " << stats.lines << " lines in " << stats.batches << " batches (avg "
+              << stats.average_batch_lines() << ", max " << stats.max_batch_lines << "), " << stats.syncs << " syncs" << std::endl;
+}
+
+// Prune log file entries older than a certain threshold.
+// The sparse time index (<log>.idx) locates the first retained line, so only the tail is read and copied
+void prune_log(const std::string &filename, std::chrono::hours retention_period) {
+    tslib::TimeIndex index;
+    if (!index.Load(filename)) return;
+
+    auto cutoff_time = std::chrono::system_clock::now() - retention_period;
+    int64_t cutoff = std::chrono::duration_cast<std::chrono::seconds>(cutoff_time.time_since_epoch()).count();
+
+    std::ifstream file(filename, std::ios::binary);
+    if (!file) return;
+
+    // Offset of the first line at or after the cutoff; the end of the log if everything is outdated
+    uint64_t keep_from = tslib::ScanLogStream(file, index.Seek(cutoff), [cutoff](int64_t timestamp, double, uint64_t, uint64_t) {
+        return timestamp < cutoff;
+    });
+    if (keep_from == 0) return; // Nothing to prune
+
+    std::string temp_name = filename + ".tmp";
+    {
+        std::ofstream out_file(temp_name, std::ios::binary | std::ios::trunc);
+        file.clear();
+        file.seekg((std::streamoff)keep_from);
+        if (file.peek() != std::ifstream::traits_type::eof()) {
+            out_file << file.rdbuf();
+        }
+    }
     file.close();
-    std::ofstream out_file(filename, std::ios::trunc);
-    for (const auto &entry : lines) {
-        out_file << entry << std::endl;
+    fs::rename(temp_name, filename);
+    index.Reset(); // Offsets changed, the index is rebuilt on next load
+}
+
+// Unix time with microseconds ("1700000000.012345"): samples of a 10-100 Hz sensor keep distinct timestamps.
+// Log readers (tslib::ParseLogLine) accept the fraction and index by whole seconds
+std::string format_timestamp(std::chrono::system_clock::time_point time) {
+    int64_t micros = std::chrono::duration_cast<std::chrono::microseconds>(time.time_since_epoch()).count();
+    int64_t seconds = micros / 1000000;
+    int64_t fraction = micros % 1000000;
+    if (fraction < 0) {
+        fraction += 1000000;
+        --seconds;
     }
+    char buf[32];
+    snprintf(buf, sizeof(buf), "%lld.%06lld", (long long)seconds, (long long)fraction);
+    return buf;
 }
 
 // Calculate average temperature from a vector of values
@@ -67,66 +265,211 @@ std::string calculate_average(const std::vector<double> &temperatures) {
     return std::to_string(sum / temperatures.size());
 }
 
-void process_temperature_data(const std::string &port) {
+// Wall-clock time derived from the monotonic clock: system time is read once at startup,
+// so NTP steps and slews while the logger runs do not reorder or skew sample timestamps
+class monotonic_wall_clock {
+public:
+    monotonic_wall_clock()
+        : system_start_(std::chrono::system_clock::now()), steady_start_(std::chrono::steady_clock::now()) {}
+
+    std::chrono::system_clock::time_point to_system(std::chrono::steady_clock::time_point time) const {
+        return system_start_ + std::chrono::duration_cast<std::chrono::system_clock::duration>(time - steady_start_);
+    }
+
+private:
+    std::chrono::system_clock::time_point system_start_;
+    std::chrono::steady_clock::time_point steady_start_;
+};
+
+enum class port_state { readable, idle, failed };
+
+// Wait until the port has bytes to read or the timeout expires.
+// COM handles cannot be polled on Windows; there the read itself waits for the port timeout
+port_state wait_for_data(splib::SerialPort &serial_port, int timeout_ms) {
+#ifdef _WIN32
+    (void)serial_port;
+    (void)timeout_ms;
+    return port_state::readable;
+#else
+    pollfd fd = {serial_port.GetHandle(), POLLIN, 0};
+    int ready = poll(&fd, 1, timeout_ms);
+    if (ready == 0 || (ready < 0 && errno == EINTR)) return port_state::idle;
+    // A disconnected device keeps reporting a hangup, so it must not be polled again
+    if (ready < 0 || (fd.revents & (POLLHUP | POLLERR | POLLNVAL)) || !(fd.revents & POLLIN)) return port_state::failed;
+    return port_state::readable;
+#endif
+}
+
+// Non-blocking reads on POSIX (poll does the waiting); COM ports wait inside the read instead
+void configure_port(splib::SerialPort &serial_port) {
+#ifdef _WIN32
+    serial_port.SetTimeout(POLL_TIMEOUT_MS / 1000.0);
+#else
+    serial_port.SetNonBlocking(true);
+#endif
+}
+
+void process_temperature_data(const std::string &port, durability_policy policy) {
     splib::SerialPort serial_port(port, splib::SerialPort::BAUDRATE_115200);
 
     if (!serial_port.IsOpen()) {
         std::cerr << "Failed to open port: " << port << std::endl;
         return;
     }
+    configure_port(serial_port);
+
+    batched_log_writer all_log(LOG_ALL_FILE, policy);
+    // Averages are rare, so every line is committed right away
+    batched_log_writer hourly_log(LOG_HOURLY_FILE, policy, 1);
+    batched_log_writer daily_log(LOG_DAILY_FILE, policy, 1);
 
     std::vector<double> hourly_temperatures;
     std::vector<double> daily_temperatures;
 
-    auto last_hour = std::chrono::system_clock::now();
-    auto last_day = std::chrono::system_clock::now();
+    monotonic_wall_clock clock;
+    auto last_hour = std::chrono::steady_clock::now();
+    auto last_day = last_hour;
+
+    // Legacy "$-6.87$" lines or binary packets, detected from the first bytes
+    splib::SensorStream stream;
+    splib::SensorPacket packet;
+    uint64_t reported_lost = 0;
+
+    // Closes a port that failed or was unplugged; it is reopened on a growing delay
+    auto retry_delay = std::chrono::steady_clock::duration(PORT_RETRY_DELAY);
+    auto next_open = std::chrono::steady_clock::now();
+    auto close_port = [&](const char *reason) {
+        std::cerr << reason << ": " << port << std::endl;
+        serial_port.Close();
+        next_open = std::chrono::steady_clock::now() + retry_delay;
+        retry_delay = std::min<std::chrono::steady_clock::duration>(retry_delay * 2, PORT_RETRY_MAX_DELAY);
+    };
 
+    std::vector<std::string> frames;
+    std::vector<std::pair<std::chrono::steady_clock::time_point, double>> samples;
     while (true) {
-        std::string temperature_data;
-        serial_port >> temperature_data;
-
-        try {
-            double temperature = std::stod(temperature_data);
-            auto now = std::chrono::system_clock::now();
-            auto timestamp = std::chrono::system_clock::to_time_t(now);
-
-            append_to_log(LOG_ALL_FILE, std::to_string(timestamp) + " " + std::to_string(temperature));
-            hourly_temperatures.push_back(temperature);
-            daily_temperatures.push_back(temperature);
-
-            if (now - last_hour >= std::chrono::hours(1)) {
-                std::string hourly_avg = calculate_average(hourly_temperatures);
-                append_to_log(LOG_HOURLY_FILE, std::to_string(timestamp) + " " + hourly_avg);
-                hourly_temperatures.clear();
-                last_hour = now;
-                prune_log(LOG_ALL_FILE, std::chrono::hours(24));
-                prune_log(LOG_HOURLY_FILE, std::chrono::hours(720));
+        if (!serial_port.IsOpen()) {
+            // Writers still flush their batches while the port is away
+            if (std::chrono::steady_clock::now() < next_open) {
+                std::this_thread::sleep_for(std::chrono::milliseconds(POLL_TIMEOUT_MS));
+                all_log.poll();
+                continue;
             }
-
-            if (now - last_day >= std::chrono::hours(24)) {
-                std::string daily_avg = calculate_average(daily_temperatures);
-                append_to_log(LOG_DAILY_FILE, std::to_string(timestamp) + " " + daily_avg);
-                daily_temperatures.clear();
-                last_day = now;
+            if (serial_port.Open(port, splib::SerialPort::Parameters(splib::SerialPort::BAUDRATE_115200)) != splib::SerialPort::RE_OK) {
+                close_port("Failed to reopen port");
+                continue;
             }
+            configure_port(serial_port);
+            stream.Reset(); // The device may come back with another format or packet numbering
+            retry_delay = PORT_RETRY_DELAY;
+            std::cerr << "Port reopened: " << port << std::endl;
+        }
 
-        } catch (const std::exception &e) {
-            std::cerr << "Error processing data: " << e.what() << std::endl;
+        // Wake as soon as bytes arrive; the timeout only drives batch deadlines of the writers
+        port_state state = wait_for_data(serial_port, POLL_TIMEOUT_MS);
+        auto arrived = std::chrono::steady_clock::now();
+        all_log.poll();
+        if (state == port_state::failed) {
+            close_port("Port is not readable");
+            continue;
         }
+        if (state == port_state::idle) continue;
 
-#ifdef _WIN32
-        Sleep(1000);
-#else
-        usleep(1000000);
+        // Drain every complete frame; a partial frame stays buffered in the port until the rest arrives
+        frames.clear();
+#ifndef _WIN32
+        uint64_t received = serial_port.GetReceivedBytes();
+        uint64_t bad_frames = stream.GetBadFrames();
+#endif
+        size_t drained = 0;
+        bool read_failed = false;
+        do {
+            drained = frames.size();
+            if (stream.ReadFrames(serial_port, frames) != splib::SerialPort::RE_OK) {
+                read_failed = true;
+                break;
+            }
+        } while (frames.size() > drained);
+#ifndef _WIN32
+        // poll reported data but nothing came: the device is gone (end of stream)
+        if (frames.empty() && serial_port.GetReceivedBytes() == received && stream.GetBadFrames() == bad_frames) {
+            read_failed = true;
+        }
 #endif
+        if (read_failed) {
+            close_port("Failed to read port");
+            continue;
+        }
+
+        // Text lines from one wakeup arrived together and share its timestamp;
+        // samples of a binary packet are spaced by its interval and end at the arrival time
+        samples.clear();
+        for (const auto &frame : frames) {
+            if (stream.GetFormat() == splib::SensorStream::FORMAT_TEXT) {
+                double temperature = 0;
+                if (tslib::ParseTemperature(frame, temperature)) {
+                    samples.push_back({arrived, temperature});
+                } else {
+                    std::cerr << "Error processing data: " << frame << std::endl;
+                }
+            } else if (stream.ParsePacket(frame, packet)) {
+                size_t count = packet.values.size();
+                for (size_t i = 0; i < count; ++i) {
+                    samples.push_back({arrived - std::chrono::milliseconds((count - 1 - i) * packet.interval_ms), packet.values[i]});
+                }
+            }
+        }
+        if (stream.GetLostPackets() > reported_lost) {
+            std::cerr << "Lost packets: " << stream.GetLostPackets() - reported_lost << std::endl;
+            reported_lost = stream.GetLostPackets();
+        }
+
+        for (const auto &[now, temperature] : samples) {
+            std::string timestamp = format_timestamp(clock.to_system(now));
+
+            try {
+
+                all_log.append(timestamp + " " + std::to_string(temperature));
+                hourly_temperatures.push_back(temperature);
+                daily_temperatures.push_back(temperature);
+
+                if (now - last_hour >= std::chrono::hours(1)) {
+                    std::string hourly_avg = calculate_average(hourly_temperatures);
+                    hourly_log.append(timestamp + " " + hourly_avg);
+                    hourly_temperatures.clear();
+                    last_hour = now;
+
+                    // prune_log replaces the files, so the writers commit first and reopen afterwards
+                    all_log.commit();
+                    hourly_log.commit();
+                    prune_log(LOG_ALL_FILE, std::chrono::hours(24));
+                    prune_log(LOG_HOURLY_FILE, std::chrono::hours(720));
+                    all_log.reopen();
+                    hourly_log.reopen();
+                    print_batch_stats(all_log);
+                }
+
+                if (now - last_day >= std::chrono::hours(24)) {
+                    std::string daily_avg = calculate_average(daily_temperatures);
+                    daily_log.append(timestamp + " " + daily_avg);
+                    daily_temperatures.clear();
+                    last_day = now;
+                }
+
+            } catch (const std::exception &e) {
+                std::cerr << "Error processing data: " << e.what() << std::endl;
+            }
+        }
     }
 }
 
 int main(int argc, char **argv) {
     std::string port = argc > 1 ? argv[1] : "COM3";
+    // none | batch | interval
+    durability_policy policy = parse_durability_policy(argc > 2 ? argv[2] : "none");
 
     try {
-        process_temperature_data(port);
+        process_temperature_data(port, policy);
     } catch (const std::exception &e) {
         std::cerr << "An error occurred: " << e.what() << std::endl;
         return -1;
@@ -0,0 +1,126 @@
+#include "time_index.hpp"
+
+#include <filesystem>
+#include <algorithm>
+#include <cstdlib>
+
+namespace fs = std::filesystem;
+
+namespace tslib
+{
+    bool TimeIndex::Load(const std::string &log_path, bool write_back)
+    {
+        m_log_path = log_path;
+        m_write_back = write_back;
+        m_entries.clear();
+        m_indexed_end = 0;
+
+        std::error_code ec;
+        uint64_t log_size = fs::file_size(log_path, ec);
+        if (ec) return false;
+
+        std::ifstream index(GetIndexPath(log_path), std::ios::binary);
+        IndexEntry entry;
+        while (index.read((char *)&entry, sizeof(entry)))
+        {
+            // Индекс от другого (перезаписанного) лога не используем
+            if (entry.offset >= log_size || (!m_entries.empty() && entry.offset <= m_entries.back().offset))
+            {
+                m_entries.clear();
+                break;
+            }
+            m_entries.push_back(entry);
+        }
+        index.close();
+
+        if (m_entries.empty() && write_back)
+        {
+            Reset();
+        }
+        else if (!m_entries.empty())
+        {
+            m_indexed_end = m_entries.back().offset;
+        }
+        return Update();
+    }
+
+    bool TimeIndex::Update()
+    {
+        std::error_code ec;
+        uint64_t log_size = fs::file_size(m_log_path, ec);
+        if (ec) return false;
+
+        if (log_size < m_indexed_end)
+        {
+            // Лог перезаписан - индексируем заново
+            if (m_write_back) Reset();
+            m_entries.clear();
+            m_indexed_end = 0;
+        }
+        if (log_size == m_indexed_end) return true;
+
+        std::ifstream log(m_log_path, std::ios::binary);
+        if (!log) return false;
+
+        // Последняя строка без перевода строки ещё дописывается - она учтётся при следующем вызове
+        size_t first_new = m_entries.size();
+        m_indexed_end = ScanLogStream(log, m_indexed_end, [this](int64_t time, double, uint64_t offset, uint64_t) {
+            if (m_entries.empty() || offset - m_entries.back().offset >= INDEX_STRIDE_BYTES)
+            {
+                m_entries.push_back({time, offset});
+            }
+            return true;
+        });
+        AppendEntries(first_new);
+        return true;
+    }
+
+    void TimeIndex::Add(int64_t time, uint64_t offset, uint64_t end)
+    {
+        size_t first_new = m_entries.size();
+        if (m_entries.empty() || offset - m_entries.back().offset >= INDEX_STRIDE_BYTES)
+        {
+            m_entries.push_back({time, offset});
+        }
+        m_indexed_end = end;
+        AppendEntries(first_new);
+    }
+
+    void TimeIndex::AppendEntries(size_t first)
+    {
+        if (!m_write_back || first >= m_entries.size()) return;
+        std::ofstream index(GetIndexPath(m_log_path), std::ios::binary | std::ios::app);
+        index.write((const char *)(m_entries.data() + first), (std::streamsize)((m_entries.size() - first) * sizeof(IndexEntry)));
+    }
+
+    uint64_t TimeIndex::Seek(int64_t time) const
+    {
+        // Последний элемент со временем строго меньше искомого: с него начинается нужный участок
+        auto it = std::lower_bound(m_entries.begin(), m_entries.end(), time,
+                                   [](const IndexEntry &entry, int64_t t) { return entry.time < t; });
+        if (it == m_entries.begin()) return 0;
+        return std::prev(it)->offset;
+    }
+
+    double GetMeanTemp(const std::string &log_path, int64_t now, int64_t diff_sec)
+    {
+        TimeIndex index;
+        if (!index.Load(log_path)) return 0.0;
+
+        double mean = 0;
+        uint64_t count = 0;
+        QueryTextLog(index, now - diff_sec + 1, INT64_MAX, [&](int64_t, double value) {
+            mean += value;
+            ++count;
+        });
+        return count > 0 ? mean / count : 0.0;
+    }
+
+    void TimeIndex::Reset()
+    {
+        std::error_code ec;
+        fs::remove(GetIndexPath(m_log_path), ec);
+        m_entries.clear();
+        m_indexed_end = 0;
+    }
+}
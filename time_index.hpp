@@ -0,0 +1,80 @@
+#ifndef TIME_INDEX_HPP
+#define TIME_INDEX_HPP
+
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <fstream>
+
+#include "log_parser.hpp"
+
+namespace tslib
+{
+#define INDEX_EXTENSION ".idx"
+#define INDEX_STRIDE_BYTES 4096
+
+    // Элемент индекса: время строки и её смещение в файле лога
+    struct IndexEntry
+    {
+        int64_t time;
+        uint64_t offset;
+    };
+
+    // Разреженный индекс текстового лога "время значение" с возрастающим временем.
+    // Хранит пару (время, смещение) для строки примерно через каждые INDEX_STRIDE_BYTES байт
+    // в файле-спутнике <лог>.idx, который дополняется по мере дозаписи лога.
+    // Поиск начала интервала - двоичный поиск по индексу и чтение не более одного шага
+    class TimeIndex
+    {
+    public:
+        // Загружает индекс лога и доиндексирует дописанные строки.
+        // write_back = false - только в памяти (для читателей, чтобы не писать файл одновременно с писателем)
+        bool Load(const std::string &log_path, bool write_back = true);
+
+        // Индексирует строки, дописанные в лог после последнего вызова; перестраивает индекс, если лог укоротился
+        bool Update();
+
+        // Учитывает строку, только что дописанную владельцем лога: время, смещение начала и конец строки
+        void Add(int64_t time, uint64_t offset, uint64_t end);
+
+        // Смещение, с которого достаточно читать лог, чтобы найти первую строку со временем >= time
+        uint64_t Seek(int64_t time) const;
+
+        // Удаляет файл индекса и очищает индекс
+        void Reset();
+
+        const std::vector<IndexEntry> &GetEntries() const { return m_entries; }
+        const std::string &GetLogPath() const { return m_log_path; }
+
+        static std::string GetIndexPath(const std::string &log_path) { return log_path + INDEX_EXTENSION; }
+
+    private:
+        void AppendEntries(size_t first);
+
+        std::string m_log_path;
+        std::vector<IndexEntry> m_entries;
+        uint64_t m_indexed_end = 0; // До этого смещения строки лога учтены
+        bool m_write_back = true;
+    };
+
+    // Среднее по строкам текстового лога за последние diff_sec секунд до now (0, если строк нет).
+    // Начало окна находится по разреженному индексу лога, а не чтением с первой строки
+    double GetMeanTemp(const std::string &log_path, int64_t now, int64_t diff_sec);
+
+    // Вызывает func(время, значение) для строк лога с from <= time < to, начиная с позиции из индекса
+    template <typename Func>
+    void QueryTextLog(const TimeIndex &index, int64_t from, int64_t to, Func &&func)
+    {
+        std::ifstream log(index.GetLogPath(), std::ios::binary);
+        if (!log) return;
+
+        ScanLogStream(log, index.Seek(from), [&](int64_t time, double value, uint64_t, uint64_t) {
+            if (time < from) return true;
+            if (time >= to) return false;
+            func(time, value);
+            return true;
+        });
+    }
+}
+
+#endif // TIME_INDEX_HPP
@@ -0,0 +1,439 @@
+#include "ts_storage.hpp"
+#include "log_parser.hpp"
+#include "compressed_segment.hpp"
+
+#include <filesystem>
+#include <fstream>
+#include <cstring>
+#include <charconv>
+#include <mutex>
+
+#ifdef WIN32
+#include <io.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+namespace fs = std::filesystem;
+
+namespace tslib
+{
+    MappedSegment::~MappedSegment()
+    {
+        Close();
+    }
+
+    bool MappedSegment::Open(const std::string &path)
+    {
+        Close();
+#ifdef WIN32
+        std::ifstream file(path, std::ios::binary);
+        if (!file) return false;
+
+        char header[SEGMENT_HEADER_SIZE];
+        if (!file.read(header, SEGMENT_HEADER_SIZE) || memcmp(header, SEGMENT_MAGIC, 8) != 0) return false;
+
+        Record rec;
+        while (file.read((char *)&rec, sizeof(rec)))
+        {
+            m_copy.push_back(rec);
+        }
+        m_records = m_copy.data();
+        m_count = m_copy.size();
+        return true;
+#else
+        int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0) return false;
+
+        struct stat st;
+        if (fstat(fd, &st) != 0 || (size_t)st.st_size < SEGMENT_HEADER_SIZE)
+        {
+            close(fd);
+            return false;
+        }
+
+        void *map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+        close(fd);
+        if (map == MAP_FAILED) return false;
+
+        if (memcmp(map, SEGMENT_MAGIC, 8) != 0)
+        {
+            munmap(map, st.st_size);
+            return false;
+        }
+
+        m_map = map;
+        m_map_size = st.st_size;
+        m_records = (const Record *)((const char *)map + SEGMENT_HEADER_SIZE);
+        m_count = (m_map_size - SEGMENT_HEADER_SIZE) / sizeof(Record);
+        return true;
+#endif
+    }
+
+    void MappedSegment::Close()
+    {
+#ifndef WIN32
+        if (m_map != nullptr)
+        {
+            munmap(m_map, m_map_size);
+        }
+#endif
+        m_map = nullptr;
+        m_map_size = 0;
+        m_records = nullptr;
+        m_count = 0;
+        m_copy.clear();
+    }
+
+    Series::~Series()
+    {
+        Close();
+    }
+
+    bool Series::Open(const std::string &dir, int64_t segment_span)
+    {
+        Close();
+        if (segment_span <= 0) return false;
+
+        std::error_code ec;
+        fs::create_directories(dir, ec);
+        if (!fs::is_directory(dir, ec)) return false;
+
+        std::vector<int64_t> segments;
+        std::vector<int64_t> raw_segments;
+        for (const auto &entry : fs::directory_iterator(dir, ec))
+        {
+            std::string extension = entry.path().extension().string();
+            if (extension != SEGMENT_EXTENSION && extension != COMPRESSED_SEGMENT_EXTENSION) continue;
+            std::string stem = entry.path().stem().string();
+            int64_t start = 0;
+            auto res = std::from_chars(stem.data(), stem.data() + stem.size(), start);
+            if (res.ec == std::errc() && res.ptr == stem.data() + stem.size())
+            {
+                segments.push_back(start);
+                if (extension == SEGMENT_EXTENSION) raw_segments.push_back(start);
+            }
+        }
+        std::sort(segments.begin(), segments.end());
+        segments.erase(std::unique(segments.begin(), segments.end()), segments.end());
+
+        std::unique_lock<std::shared_mutex> lock(m_mutex);
+        m_dir = dir;
+        m_span = segment_span;
+        m_segments = segments;
+        m_last_time = INT64_MIN;
+
+        // Несжатыми остаются только последний сегмент (в него ещё пишут) и сегменты,
+        // которые не успели запечатать до завершения
+        for (auto start : raw_segments)
+        {
+            if (start != m_segments.back()) SealSegment(start);
+        }
+
+        // Время последней записи - для контроля монотонности
+        for (auto it = m_segments.rbegin(); it != m_segments.rend(); ++it)
+        {
+            CompressedSegment compressed;
+            MappedSegment segment;
+            if (compressed.Open(GetCompressedPath(*it)) && compressed.GetBlockCount() > 0)
+            {
+                m_last_time = compressed.GetBlock(compressed.GetBlockCount() - 1).last_time;
+                break;
+            }
+            if (segment.Open(GetSegmentPath(*it)) && segment.Size() > 0)
+            {
+                m_last_time = (segment.End() - 1)->time;
+                break;
+            }
+        }
+        return true;
+    }
+
+    void Series::Close()
+    {
+        std::unique_lock<std::shared_mutex> lock(m_mutex);
+        if (m_fd >= 0)
+        {
+            close(m_fd);
+        }
+        m_fd = -1;
+        m_fd_segment = INT64_MIN;
+        m_segments.clear();
+        m_dir.clear();
+        m_last_time = INT64_MIN;
+    }
+
+    std::string Series::GetSegmentPath(int64_t segment_start) const
+    {
+        return m_dir + "/" + std::to_string(segment_start) + SEGMENT_EXTENSION;
+    }
+
+    std::string Series::GetCompressedPath(int64_t segment_start) const
+    {
+        return m_dir + "/" + std::to_string(segment_start) + COMPRESSED_SEGMENT_EXTENSION;
+    }
+
+    // Сжимает сегмент, в который больше не пишут, и удаляет исходный .seg.
+    // Читатели, уже открывшие .seg, дочитывают его из отображения в память
+    bool Series::SealSegment(int64_t segment_start)
+    {
+        std::string path = GetSegmentPath(segment_start);
+        std::string compressed_path = GetCompressedPath(segment_start);
+        std::error_code ec;
+        if (!fs::exists(compressed_path, ec))
+        {
+            MappedSegment segment;
+            if (!segment.Open(path) ||
+                !WriteCompressedSegment(compressed_path, segment_start, segment.Begin(), segment.End()))
+            {
+                return false;
+            }
+        }
+        // Сжатый файл появляется переименованием, так что если он есть, то он полный
+        fs::remove(path, ec);
+        return true;
+    }
+
+    bool Series::OpenSegment(int64_t segment_start)
+    {
+        if (m_fd >= 0)
+        {
+            close(m_fd);
+            m_fd = -1;
+        }
+
+        // Запечатанный сегмент только для чтения
+        std::error_code ec;
+        if (fs::exists(GetCompressedPath(segment_start), ec)) return false;
+        if (!m_segments.empty() && m_segments.back() < segment_start)
+        {
+            SealSegment(m_segments.back());
+        }
+
+        std::string path = GetSegmentPath(segment_start);
+#ifdef WIN32
+        int fd = open(path.c_str(), O_RDWR | O_CREAT | O_BINARY, _S_IREAD | _S_IWRITE);
+#else
+        int fd = open(path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+#endif
+        if (fd < 0) return false;
+
+        struct stat st;
+        if (fstat(fd, &st) != 0)
+        {
+            close(fd);
+            return false;
+        }
+
+        size_t size = (size_t)st.st_size;
+        if (size < SEGMENT_HEADER_SIZE)
+        {
+            // Новый сегмент: заголовок из магического слова и времени начала
+            char header[SEGMENT_HEADER_SIZE];
+            memcpy(header, SEGMENT_MAGIC, 8);
+            memcpy(header + 8, &segment_start, sizeof(segment_start));
+            if (ftruncate(fd, 0) != 0 || write(fd, header, SEGMENT_HEADER_SIZE) != SEGMENT_HEADER_SIZE)
+            {
+                close(fd);
+                return false;
+            }
+            size = SEGMENT_HEADER_SIZE;
+        }
+        else if ((size - SEGMENT_HEADER_SIZE) % sizeof(Record) != 0)
+        {
+            // Обрезаем запись, недописанную при аварийном завершении
+            size -= (size - SEGMENT_HEADER_SIZE) % sizeof(Record);
+            if (ftruncate(fd, size) != 0)
+            {
+                close(fd);
+                return false;
+            }
+        }
+        lseek(fd, size, SEEK_SET);
+
+        m_fd = fd;
+        m_fd_segment = segment_start;
+        if (m_segments.empty() || m_segments.back() < segment_start)
+        {
+            m_segments.push_back(segment_start);
+        }
+        return true;
+    }
+
+    bool Series::Append(int64_t time, double value)
+    {
+        std::unique_lock<std::shared_mutex> lock(m_mutex);
+        if (m_dir.empty() || time < m_last_time) return false;
+
+        int64_t segment_start = time - ((time % m_span) + m_span) % m_span;
+        if (segment_start != m_fd_segment && !OpenSegment(segment_start))
+        {
+            return false;
+        }
+
+        Record rec = {time, value};
+        if (write(m_fd, &rec, sizeof(rec)) != (ssize_t)sizeof(rec))
+        {
+            return false;
+        }
+        m_last_time = time;
+        return true;
+    }
+
+    void Series::DropBefore(int64_t time)
+    {
+        std::unique_lock<std::shared_mutex> lock(m_mutex);
+        while (!m_segments.empty() && m_segments.front() + m_span <= time)
+        {
+            if (m_segments.front() == m_fd_segment)
+            {
+                close(m_fd);
+                m_fd = -1;
+                m_fd_segment = INT64_MIN;
+            }
+            std::error_code ec;
+            fs::remove(GetSegmentPath(m_segments.front()), ec);
+            fs::remove(GetCompressedPath(m_segments.front()), ec);
+            m_segments.erase(m_segments.begin());
+        }
+    }
+
+    void Series::Sync()
+    {
+        std::shared_lock<std::shared_mutex> lock(m_mutex);
+        if (m_fd < 0) return;
+#ifdef WIN32
+        _commit(m_fd);
+#else
+        fdatasync(m_fd);
+#endif
+    }
+
+    std::vector<int64_t> Series::GetSegments(int64_t from, int64_t to) const
+    {
+        std::shared_lock<std::shared_mutex> lock(m_mutex);
+        std::vector<int64_t> segments;
+        for (auto start : m_segments)
+        {
+            if (start < to && start + m_span > from)
+            {
+                segments.push_back(start);
+            }
+        }
+        return segments;
+    }
+
+    std::vector<int64_t> Series::GetSegmentStarts() const
+    {
+        std::shared_lock<std::shared_mutex> lock(m_mutex);
+        return m_segments;
+    }
+
+    std::vector<Record> Series::Read(int64_t from, int64_t to) const
+    {
+        std::vector<Record> records;
+        Query(from, to, [&records](const Record &rec) { records.push_back(rec); });
+        return records;
+    }
+
+    std::vector<Bucket> Series::Downsample(int64_t from, int64_t to, int64_t step) const
+    {
+        if (step <= 0 || from >= to) return {};
+
+        Downsampler downsampler(from, step);
+        std::vector<Record> unused;
+        for (auto segment_start : GetSegments(from, to))
+        {
+            // Сжатые сегменты агрегируются по заголовкам блоков, где это возможно
+            if (ReadCompressed(segment_start, from, to, unused, &downsampler)) continue;
+            Query(std::max(from, segment_start), std::min(to, segment_start + m_span),
+                  [&downsampler](const Record &rec) { downsampler.Add(rec.time, rec.value); });
+        }
+        return downsampler.buckets;
+    }
+
+    bool Series::ReadCompressed(int64_t segment_start, int64_t from, int64_t to, std::vector<Record> &records,
+                                Downsampler *downsampler) const
+    {
+        CompressedSegment segment;
+        if (!segment.Open(GetCompressedPath(segment_start))) return false;
+
+        std::vector<Record> block_records;
+        for (size_t i = 0; i < segment.GetBlockCount(); ++i)
+        {
+            const BlockHeader &header = segment.GetBlock(i);
+            if (header.last_time < from || header.first_time >= to) continue;
+
+            if (downsampler != nullptr && header.first_time >= from && header.last_time < to &&
+                (header.first_time - from) / downsampler->step == (header.last_time - from) / downsampler->step)
+            {
+                downsampler->AddAggregate(GetBlockAggregate(header), header.last_value);
+                continue;
+            }
+
+            // Повреждённый блок отдаёт записи, распакованные до ошибки
+            block_records.clear();
+            segment.DecodeBlock(i, block_records);
+            for (const auto &rec : block_records)
+            {
+                if (rec.time < from || rec.time >= to) continue;
+                if (downsampler != nullptr)
+                {
+                    downsampler->Add(rec.time, rec.value);
+                }
+                else
+                {
+                    records.push_back(rec);
+                }
+            }
+        }
+        return true;
+    }
+
+    void AppendTextRecord(std::string &out, int64_t time, double value)
+    {
+        char buf[64];
+        auto res = std::to_chars(buf, buf + sizeof(buf), time);
+        *res.ptr++ = ' ';
+        res = std::to_chars(res.ptr, buf + sizeof(buf) - 1, value);
+        *res.ptr++ = '\n';
+        out.append(buf, res.ptr - buf);
+    }
+
+    std::string Series::ExportText(int64_t from, int64_t to) const
+    {
+        std::string out;
+        Query(from, to, [&out](const Record &rec) { AppendTextRecord(out, rec.time, rec.value); });
+        return out;
+    }
+
+    size_t Series::ImportText(const std::string &file_path)
+    {
+        LogColumns columns;
+        if (!ScanLogFile(file_path, columns)) return 0;
+
+        size_t count = 0;
+        for (size_t i = 0; i < columns.Size(); ++i)
+        {
+            if (Append(columns.times[i], columns.values[i])) ++count;
+        }
+        return count;
+    }
+
+    bool Series::Empty() const
+    {
+        std::shared_lock<std::shared_mutex> lock(m_mutex);
+        return m_last_time == INT64_MIN;
+    }
+
+    int64_t Series::GetLastTime() const
+    {
+        std::shared_lock<std::shared_mutex> lock(m_mutex);
+        return m_last_time;
+    }
+}
@@ -0,0 +1,154 @@
+#ifndef TS_STORAGE_HPP
+#define TS_STORAGE_HPP
+
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <shared_mutex>
+#include <algorithm>
+
+#include "aggregates.hpp"
+
+namespace tslib
+{
+#define SEGMENT_MAGIC "TSDBSEG1"
+#define SEGMENT_HEADER_SIZE 16
+#define SEGMENT_EXTENSION ".seg"
+
+    // Запись временного ряда фиксированного размера
+    struct Record
+    {
+        int64_t time;
+        double value;
+    };
+    static_assert(sizeof(Record) == 16, "Record must be 16 bytes");
+
+    // Отображённый в память сегмент (только чтение). Неполная последняя запись игнорируется
+    class MappedSegment
+    {
+    public:
+        MappedSegment() = default;
+        ~MappedSegment();
+
+        MappedSegment(const MappedSegment &) = delete;
+        MappedSegment &operator=(const MappedSegment &) = delete;
+
+        bool Open(const std::string &path);
+        void Close();
+
+        const Record *Begin() const { return m_records; }
+        const Record *End() const { return m_records + m_count; }
+        size_t Size() const { return m_count; }
+
+    private:
+        const Record *m_records = nullptr;
+        size_t m_count = 0;
+        void *m_map = nullptr;
+        size_t m_map_size = 0;
+        std::vector<Record> m_copy; // Без mmap (Windows) записи читаются в память
+    };
+
+    // Временной ряд: каталог сегментов <начало>.seg, каждый покрывает segment_span секунд.
+    // Сегмент - заголовок (магическое слово, начало) и записи Record по возрастанию времени.
+    // Запись только в конец; устаревшие данные удаляются целыми сегментами.
+    // Сегмент, в который больше не пишут, запечатывается: сжимается в <начало>.gseg (CompressedSegment)
+    class Series
+    {
+    public:
+        Series() = default;
+        ~Series();
+
+        Series(const Series &) = delete;
+        Series &operator=(const Series &) = delete;
+
+        // Открывает (создаёт) каталог ряда и находит существующие сегменты
+        bool Open(const std::string &dir, int64_t segment_span);
+        void Close();
+        bool IsOpen() const { return !m_dir.empty(); }
+
+        // Добавляет запись; время не должно убывать
+        bool Append(int64_t time, double value);
+
+        // Удаляет сегменты, целиком лежащие раньше time
+        void DropBefore(int64_t time);
+
+        // Сбрасывает данные текущего сегмента на диск
+        void Sync();
+
+        // Вызывает func(const Record&) для записей с from <= time < to
+        template <typename Func>
+        void Query(int64_t from, int64_t to, Func &&func) const
+        {
+            std::vector<Record> records;
+            for (const auto &segment_start : GetSegments(from, to))
+            {
+                records.clear();
+                MappedSegment segment;
+                // Сегмент могли запечатать между попытками открыть .gseg и .seg
+                if (ReadCompressed(segment_start, from, to, records) ||
+                    (!segment.Open(GetSegmentPath(segment_start)) && ReadCompressed(segment_start, from, to, records)))
+                {
+                    for (const auto &rec : records)
+                    {
+                        func(rec);
+                    }
+                    continue;
+                }
+                if (segment.Size() == 0) continue;
+
+                auto it = std::lower_bound(segment.Begin(), segment.End(), from,
+                                           [](const Record &rec, int64_t t) { return rec.time < t; });
+                for (; it != segment.End() && it->time < to; ++it)
+                {
+                    func(*it);
+                }
+            }
+        }
+
+        // Записи в диапазоне [from, to)
+        std::vector<Record> Read(int64_t from, int64_t to) const;
+
+        // Прореживание [from, to) по интервалам step секунд; пустые интервалы пропускаются
+        std::vector<Bucket> Downsample(int64_t from, int64_t to, int64_t step) const;
+
+        // Текст "время значение" по строке на запись, как в текстовых логах
+        std::string ExportText(int64_t from, int64_t to) const;
+
+        // Импортирует текстовый лог "время значение"; возвращает число записей
+        size_t ImportText(const std::string &file_path);
+
+        bool Empty() const;
+        int64_t GetLastTime() const;
+        const std::string &GetDir() const { return m_dir; }
+        int64_t GetSpan() const { return m_span; }
+
+        // Начала сегментов по возрастанию; все, кроме последнего, запечатаны и больше не меняются
+        std::vector<int64_t> GetSegmentStarts() const;
+
+    private:
+        std::string GetSegmentPath(int64_t segment_start) const;
+        std::string GetCompressedPath(int64_t segment_start) const;
+        std::vector<int64_t> GetSegments(int64_t from, int64_t to) const;
+        bool OpenSegment(int64_t segment_start);
+        bool SealSegment(int64_t segment_start);
+
+        // Записи [from, to) сжатого сегмента дописываются в records, а при downsampler - сразу раскладываются
+        // по интервалам; блоки, целиком лежащие в одном интервале, берутся из заголовков без распаковки.
+        // false - сжатого сегмента нет
+        bool ReadCompressed(int64_t segment_start, int64_t from, int64_t to, std::vector<Record> &records,
+                            Downsampler *downsampler = nullptr) const;
+
+        std::string m_dir;
+        int64_t m_span = 0;
+        std::vector<int64_t> m_segments; // Начала сегментов по возрастанию
+        int64_t m_last_time = INT64_MIN;
+        int m_fd = -1; // Текущий сегмент для дозаписи
+        int64_t m_fd_segment = INT64_MIN;
+        mutable std::shared_mutex m_mutex; // Защищает m_segments и m_last_time
+    };
+
+    // Добавляет к строке запись в текстовом формате логов
+    void AppendTextRecord(std::string &out, int64_t time, double value);
+}
+
+#endif // TS_STORAGE_HPP